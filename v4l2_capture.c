@@ -0,0 +1,1967 @@
+/**
+ * @file v4l2_capture.c
+ *
+ * libv4l2capture - basic v4l2 streaming (mmap) video capture behind a context handle.
+ * Frames are handed out zero-copy: v4l2_capture_acquire_frame() dequeues a buffer
+ * and exposes its mapping, v4l2_capture_release_frame() queues it back to the driver.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <linux/videodev2.h>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "v4l2_capture.h"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define V4l2_SELECT_TIMEOUT_SEC 10
+
+#define V4L2_RT_PREFAULT_STACK_SIZE (64 * 1024)
+
+#define V4L2_FRAME_RATE_WINDOW_NS 1000000000ULL
+
+#define V4L2_MAX_PROFILE_CONTROLS 5
+
+#define V4L2_REPLAY_FRAME_MAGIC 0x46523456 /* 'V4RF' */
+
+/* a gap of that many typical frame intervals separates two recording sessions */
+#define V4L2_REPLAY_SEGMENT_GAP_FACTOR 8
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+struct v4l2_buffer_descriptor
+{
+    int index;
+    void* addr;
+    size_t size;
+    uint32_t offset;
+};
+
+/* layout of struct sched_attr as expected by sched_setattr(2) */
+struct v4l2_sched_attr
+{
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+/* precedes every frame in a stream written by v4l2_capture_record_frame() */
+struct v4l2_replay_frame_header
+{
+    uint32_t magic;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesperline;
+    uint32_t sequence;
+    uint64_t timestamp_ns;
+    uint64_t size;
+};
+
+struct v4l2_replay_frame
+{
+    const uint8_t* data;
+    size_t size;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesperline;
+    uint64_t timestamp_ns;
+    bool segment_start;                  /* first frame of a recording session, not paced against earlier ones */
+};
+
+struct v4l2_replay_mapping
+{
+    void* addr;
+    size_t size;
+    dev_t dev;                           /* identify the mapped file, which must not be written to */
+    ino_t ino;
+};
+
+struct v4l2_capture
+{
+    int fd;                              /* -1 for replay sources */
+    bool verbose;
+    bool verbose_frames;                 /* per frame prints, never in real-time mode as they may block */
+    bool streaming;
+    struct v4l2_format selected_format;
+    uint64_t frame_interval_ns;
+    struct v4l2_buffer_descriptor* buffer_descriptors;
+    int number_of_buffers;
+
+    /* frame rate monitoring, done over windows of V4L2_FRAME_RATE_WINDOW_NS */
+    uint64_t window_start_ns;
+    uint32_t window_start_sequence;
+    uint32_t window_frames;
+    uint64_t measured_interval_ns;
+    bool frame_rate_deviates;
+
+    /* replay source, frames are handed out straight from read-only file mappings */
+    bool replay;
+    struct v4l2_replay_mapping* replay_mappings;
+    int replay_number_of_mappings;
+    struct v4l2_replay_frame* replay_frames;
+    int replay_number_of_frames;
+    int replay_loops;
+    bool replay_paced;
+    int replay_position;
+    int replay_loop;
+    uint32_t replay_sequence;
+    uint64_t replay_interval_ns;         /* median of the frame intervals within recording sessions */
+    uint64_t replay_base_ns;             /* when the first frame of the current session was delivered */
+    uint64_t replay_segment_ns;          /* timestamp of that frame */
+    uint64_t replay_last_ns;             /* when the previous frame was delivered */
+};
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+static const char* v4l2_capabilities_to_string(char* buf, size_t size, uint32_t capabilities);
+static const char* v4l2_buf_type_to_string(enum v4l2_buf_type buf_type);
+static const char* v4l2_frmsizetype_to_string(enum v4l2_frmsizetypes type);
+static const char* v4l2_frmivaltype_to_string(enum v4l2_frmivaltypes type);
+static void v4l2_print_capabilities(const struct v4l2_capability* caps);
+static void v4l2_print_fmtdesc(const struct v4l2_fmtdesc* fmtdesc);
+static void v4l2_print_frmsizeenum(const struct v4l2_frmsizeenum* frmsizeenum);
+static void v4l2_print_frmivalenum(const struct v4l2_frmivalenum* frmivalenum);
+static void v4l2_print_cropping_capabilities(const struct v4l2_cropcap* cropcap);
+static void v4l2_print_format(const struct v4l2_format* format);
+static const char* v4l2_ctrl_type_to_string(uint32_t type);
+static void v4l2_print_query_ext_ctrl(const struct v4l2_query_ext_ctrl* qctrl);
+static void v4l2_print_querymenu(const struct v4l2_querymenu* querymenu, uint32_t type);
+static void v4l2_query_controls(struct v4l2_capture* ctx);
+static int v4l2_set_frame_rate(struct v4l2_capture* ctx, uint32_t frame_rate);
+static int v4l2_apply_controls(struct v4l2_capture* ctx, const struct v4l2_capture_control_profile* profile);
+static void v4l2_update_frame_rate(struct v4l2_capture* ctx, const struct v4l2_capture_frame* frame);
+static uint32_t v4l2_query_capabilities(struct v4l2_capture* ctx, uint32_t flags);
+static int v4l2_query_buffers(struct v4l2_capture* ctx, int number_of_buffers);
+static void v4l2_unmap_buffers(struct v4l2_capture* ctx);
+static int v4l2_queue_buffers(struct v4l2_capture* ctx);
+static uint64_t v4l2_query_frame_interval(struct v4l2_capture* ctx);
+static int v4l2_rt_setup(struct v4l2_capture* ctx, const struct v4l2_capture_rt_config* config);
+static void v4l2_rt_prefault_buffers(struct v4l2_capture* ctx);
+static int v4l2_replay_add_frame(struct v4l2_capture* ctx, const struct v4l2_replay_frame* frame);
+static int v4l2_replay_add_file(struct v4l2_capture* ctx, const char* filename,
+    const struct v4l2_capture_replay_config* config);
+static int v4l2_replay_find_segments(struct v4l2_capture* ctx);
+static int v4l2_replay_compare_u64(const void* a, const void* b);
+static uint64_t v4l2_replay_frame_interval(const struct v4l2_capture* ctx);
+static int v4l2_replay_acquire_frame(struct v4l2_capture* ctx, struct v4l2_capture_frame* frame);
+static void v4l2_replay_close(struct v4l2_capture* ctx);
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+struct v4l2_capture* v4l2_capture_open(const char* filename)
+{
+    struct v4l2_capture* ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (NULL == ctx) {
+        fprintf(stderr, "calloc(1, %zu) failed\n", sizeof(*ctx));
+        return NULL;
+    }
+
+    ctx->fd = open(filename, O_RDWR);
+    if (-1 == ctx->fd) {
+        fprintf(stderr, "cannot open '%s': %s\n", filename, strerror(errno));
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+struct v4l2_capture* v4l2_capture_open_replay(const struct v4l2_capture_replay_config* config)
+{
+    struct v4l2_capture* ctx;
+    const struct v4l2_replay_frame* first;
+    int i;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (NULL == ctx) {
+        fprintf(stderr, "calloc(1, %zu) failed\n", sizeof(*ctx));
+        return NULL;
+    }
+
+    ctx->fd = -1;
+    ctx->replay = true;
+    ctx->replay_loops = config->loops;
+    ctx->replay_paced = config->paced;
+
+    for (i = 0; i < config->number_of_files; ++i)
+        if (v4l2_replay_add_file(ctx, config->filenames[i], config)) {
+            v4l2_capture_close(ctx);
+            return NULL;
+        }
+
+    if (ctx->replay_number_of_frames == 0) {
+        fprintf(stderr, "no frames to replay\n");
+        v4l2_capture_close(ctx);
+        return NULL;
+    }
+
+    if (v4l2_replay_find_segments(ctx)) {
+        v4l2_capture_close(ctx);
+        return NULL;
+    }
+
+    /* frames are the buffers of a replay source */
+    ctx->number_of_buffers = ctx->replay_number_of_frames;
+
+    first = ctx->replay_frames;
+    ctx->selected_format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ctx->selected_format.fmt.pix.pixelformat = first->fourcc;
+    ctx->selected_format.fmt.pix.width = first->width;
+    ctx->selected_format.fmt.pix.height = first->height;
+    ctx->selected_format.fmt.pix.bytesperline = first->bytesperline;
+    ctx->selected_format.fmt.pix.sizeimage = first->size;
+
+    return ctx;
+}
+
+void v4l2_capture_close(struct v4l2_capture* ctx)
+{
+    if (NULL == ctx)
+        return;
+
+    if (ctx->replay) {
+        v4l2_replay_close(ctx);
+        free(ctx);
+        return;
+    }
+
+    if (ctx->streaming)
+        v4l2_capture_stop(ctx);
+
+    v4l2_unmap_buffers(ctx);
+    close(ctx->fd);
+    free(ctx);
+}
+
+int v4l2_capture_configure(struct v4l2_capture* ctx, const struct v4l2_capture_config* config)
+{
+    int retval = -1;
+
+    do {
+        uint32_t capabilities;
+        int number_of_buffers;
+
+        if (ctx->streaming) {
+            fprintf(stderr, "cannot configure while streaming\n");
+            break;
+        }
+
+        if (ctx->replay) {
+            /* format is given by the recorded frames, there are no controls to apply */
+            ctx->verbose = config->verbose;
+            ctx->verbose_frames = config->verbose && !config->rt.enabled;
+            ctx->frame_interval_ns = v4l2_replay_frame_interval(ctx);
+
+            if (ctx->verbose)
+                v4l2_print_format(&ctx->selected_format);
+
+            /* mlockall(MCL_CURRENT) populates and locks the already mapped files */
+            if (config->rt.enabled)
+                if (v4l2_rt_setup(ctx, &config->rt)) {
+                    fprintf(stderr, "v4l2_rt_setup() failed\n");
+                    break;
+                }
+
+            retval = 0;
+            break;
+        }
+
+        v4l2_unmap_buffers(ctx);
+
+        ctx->verbose = config->verbose;
+        ctx->verbose_frames = config->verbose && !config->rt.enabled;
+        memset(&ctx->selected_format, 0, sizeof(ctx->selected_format));
+
+        capabilities = v4l2_query_capabilities(ctx,
+            config->use_compressed_formats ? V4L2_FMT_FLAG_COMPRESSED : 0);
+        if (!(capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
+            !(capabilities & V4L2_CAP_STREAMING)) {
+            fprintf(stderr, "device do not support video capture or streaming\n");
+            break;
+        }
+
+        if (ctx->selected_format.type == 0) {
+            fprintf(stderr, "No frame format is selected for capturing\n");
+            break;
+        }
+
+        if (ctx->verbose)
+            v4l2_print_format(&ctx->selected_format);
+
+        if (-1 == ioctl(ctx->fd, VIDIOC_S_FMT, &ctx->selected_format)) {
+            fprintf(stderr, "VIDIOC_S_FMT failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (config->frame_rate > 0)
+            if (v4l2_set_frame_rate(ctx, config->frame_rate)) {
+                fprintf(stderr, "v4l2_set_frame_rate() failed\n");
+                break;
+            }
+
+        ctx->frame_interval_ns = v4l2_query_frame_interval(ctx);
+
+        if (ctx->verbose)
+            v4l2_query_controls(ctx);
+
+        if (config->controls)
+            if (v4l2_apply_controls(ctx, config->controls)) {
+                fprintf(stderr, "v4l2_apply_controls() failed\n");
+                break;
+            }
+
+        if (config->rt.enabled)
+            if (v4l2_rt_setup(ctx, &config->rt)) {
+                fprintf(stderr, "v4l2_rt_setup() failed\n");
+                break;
+            }
+
+        number_of_buffers = config->number_of_buffers < 1 ? 1 : config->number_of_buffers;
+        if (v4l2_query_buffers(ctx, number_of_buffers) < 0) {
+            fprintf(stderr, "v4l2_query_buffers() failed\n");
+            break;
+        }
+
+        if (config->rt.enabled)
+            v4l2_rt_prefault_buffers(ctx);
+
+        retval = 0;
+    } while (0);
+
+    return retval;
+}
+
+int v4l2_capture_start(struct v4l2_capture* ctx)
+{
+    uint32_t type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (ctx->number_of_buffers == 0) {
+        fprintf(stderr, "v4l2_capture_configure() has to be called first\n");
+        return -1;
+    }
+
+    if (ctx->replay) {
+        ctx->replay_position = 0;
+        ctx->replay_loop = 0;
+        ctx->replay_sequence = 0;
+        ctx->replay_base_ns = 0;
+    } else
+    if (v4l2_queue_buffers(ctx)) {
+        fprintf(stderr, "v4l2_queue_buffers() failed\n");
+        return -1;
+    }
+
+    if(!ctx->replay && -1 == ioctl(ctx->fd, VIDIOC_STREAMON, &type)) {
+        fprintf(stderr, "VIDIOC_STREAMON failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ctx->streaming = true;
+
+    ctx->window_frames = 0;
+    ctx->measured_interval_ns = 0;
+    ctx->frame_rate_deviates = false;
+
+    return 0;
+}
+
+int v4l2_capture_stop(struct v4l2_capture* ctx)
+{
+    uint32_t type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    /* STREAMOFF also returns all buffers (queued or not) to the dequeued state */
+    if(!ctx->replay && -1 == ioctl(ctx->fd, VIDIOC_STREAMOFF, &type)) {
+        fprintf(stderr, "VIDIOC_STREAMOFF failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ctx->streaming = false;
+
+    return 0;
+}
+
+int v4l2_capture_acquire_frame(struct v4l2_capture* ctx, struct v4l2_capture_frame* frame)
+{
+    int retval = -1;
+
+    if (!ctx->streaming) {
+        fprintf(stderr, "v4l2_capture_start() has to be called first\n");
+        return -1;
+    }
+
+    if (ctx->replay)
+        return v4l2_replay_acquire_frame(ctx, frame);
+
+    do {
+        int status;
+        struct v4l2_buffer buffer;
+        fd_set fds;
+        struct timespec ts;
+
+        FD_ZERO(&fds);
+        FD_SET(ctx->fd, &fds);
+
+        ts.tv_sec = V4l2_SELECT_TIMEOUT_SEC;
+        ts.tv_nsec = 0;
+        status = pselect(ctx->fd+1, &fds, NULL, NULL, &ts, NULL);
+        if (-1 == status) {
+            fprintf(stderr, "pselect() failed: %s\n", strerror(errno));
+            break;
+        } else
+        if (0 == status) {
+            fprintf(stderr, "no data within %d seconds, timeout expired\n", V4l2_SELECT_TIMEOUT_SEC);
+            break;
+        }
+
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+
+        if(-1 == ioctl(ctx->fd, VIDIOC_DQBUF, &buffer)) {
+            fprintf(stderr, "VIDIOC_DQBUF failed: %s\n", strerror(errno));
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        if (ctx->verbose_frames)
+            fprintf(stdout,
+                "VIDIOC_DQBUF[%u]:\n"
+                "\tbytesused: %u\n",
+                buffer.index, buffer.bytesused
+                );
+
+        frame->index = buffer.index;
+        frame->data = ctx->buffer_descriptors[buffer.index].addr;
+        frame->size = buffer.bytesused;
+        frame->fourcc = ctx->selected_format.fmt.pix.pixelformat;
+        frame->width = ctx->selected_format.fmt.pix.width;
+        frame->height = ctx->selected_format.fmt.pix.height;
+        frame->bytesperline = ctx->selected_format.fmt.pix.bytesperline;
+        frame->sequence = buffer.sequence;
+        frame->flags = buffer.flags;
+        frame->timestamp = buffer.timestamp;
+        frame->dequeue_time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+        v4l2_update_frame_rate(ctx, frame);
+
+        retval = 0;
+    } while (0);
+
+    return retval;
+}
+
+int v4l2_capture_release_frame(struct v4l2_capture* ctx, const struct v4l2_capture_frame* frame)
+{
+    struct v4l2_buffer buffer;
+
+    if (frame->index < 0 || frame->index >= ctx->number_of_buffers) {
+        fprintf(stderr, "invalid buffer index %d\n", frame->index);
+        return -1;
+    }
+
+    /* replayed frames stay mapped for the whole lifetime of the context */
+    if (ctx->replay)
+        return 0;
+
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = frame->index;
+
+    if(-1 == ioctl(ctx->fd, VIDIOC_QBUF, &buffer)) {
+        fprintf(stderr, "VIDIOC_QBUF failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int v4l2_capture_run(struct v4l2_capture* ctx, int number_of_frames,
+    v4l2_capture_callback callback, void* user)
+{
+    int retval = -1;
+
+    do {
+        int i;
+        int status = 0;
+        bool failed = false;
+
+        if (v4l2_capture_start(ctx))
+            break;
+
+        /* number_of_frames <= 0 means: until the callback asks to stop */
+        for (i = 0; (number_of_frames <= 0 || i < number_of_frames) && status == 0; ++i) {
+            struct v4l2_capture_frame frame;
+            int acquired = v4l2_capture_acquire_frame(ctx, &frame);
+
+            if (acquired == V4L2_CAPTURE_END_OF_STREAM)
+                break;
+
+            /* a bounded capture skips the frame, an unbounded one would never end otherwise */
+            if (acquired) {
+                if (number_of_frames <= 0) {
+                    failed = true;
+                    break;
+                }
+                continue;
+            }
+
+            status = callback(ctx, &frame, user);
+
+            /* the buffer is lost for the driver, the stream cannot go on */
+            if (v4l2_capture_release_frame(ctx, &frame)) {
+                failed = true;
+                break;
+            }
+        }
+
+        /* streaming is stopped even when it failed */
+        if (v4l2_capture_stop(ctx) || failed)
+            break;
+
+        retval = 0;
+    } while (0);
+
+    return retval;
+}
+
+const struct v4l2_format* v4l2_capture_get_format(const struct v4l2_capture* ctx)
+{
+    return &ctx->selected_format;
+}
+
+uint64_t v4l2_capture_get_frame_interval(const struct v4l2_capture* ctx)
+{
+    return ctx->frame_interval_ns;
+}
+
+int v4l2_capture_get_number_of_buffers(const struct v4l2_capture* ctx)
+{
+    return ctx->number_of_buffers;
+}
+
+uint64_t v4l2_capture_get_measured_frame_interval(const struct v4l2_capture* ctx)
+{
+    return ctx->measured_interval_ns;
+}
+
+int v4l2_capture_record_frame(int fd, const struct v4l2_capture_frame* frame)
+{
+    struct v4l2_replay_frame_header header;
+    const uint8_t* p;
+    size_t left;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = V4L2_REPLAY_FRAME_MAGIC;
+    header.fourcc = frame->fourcc;
+    header.width = frame->width;
+    header.height = frame->height;
+    header.bytesperline = frame->bytesperline;
+    header.sequence = frame->sequence;
+    header.timestamp_ns = frame->dequeue_time_ns;
+    header.size = frame->size;
+
+    if (sizeof(header) != write(fd, &header, sizeof(header))) {
+        fprintf(stderr, "write() failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (p = frame->data, left = frame->size; left > 0; ) {
+        ssize_t n = write(fd, p, left);
+        if (-1 == n) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "write() failed: %s\n", strerror(errno));
+            return -1;
+        }
+        p += n;
+        left -= n;
+    }
+
+    return 0;
+}
+
+bool v4l2_capture_is_replay_source(const struct v4l2_capture* ctx, int fd)
+{
+    struct stat st;
+    int i;
+
+    if (!ctx->replay || -1 == fstat(fd, &st))
+        return false;
+
+    for (i = 0; i < ctx->replay_number_of_mappings; ++i)
+        if (ctx->replay_mappings[i].dev == st.st_dev && ctx->replay_mappings[i].ino == st.st_ino)
+            return true;
+
+    return false;
+}
+
+void v4l2_capture_control_profile_init(struct v4l2_capture_control_profile* profile)
+{
+    profile->exposure_auto = V4L2_CAPTURE_CONTROL_UNSET;
+    profile->exposure_absolute = V4L2_CAPTURE_CONTROL_UNSET;
+    profile->exposure_auto_priority = V4L2_CAPTURE_CONTROL_UNSET;
+    profile->gain = V4L2_CAPTURE_CONTROL_UNSET;
+    profile->power_line_frequency = V4L2_CAPTURE_CONTROL_UNSET;
+    profile->lock_fps = false;
+}
+
+/**
+ * Parses comma separated list of key=value pairs, e.g.
+ * "exposure=manual,exposure-time=100,gain=0,power-line=50,lock-fps".
+ * Keys which are not present leave the corresponding profile entries untouched.
+ */
+int v4l2_capture_control_profile_parse(struct v4l2_capture_control_profile* profile, const char* str)
+{
+    int retval = -1;
+    char* copy;
+    char* saveptr = NULL;
+    char* token;
+
+    static const struct {
+        const char* name;
+        int32_t value;
+    } exposure_modes[] = {
+        {"auto",     V4L2_EXPOSURE_AUTO},
+        {"manual",   V4L2_EXPOSURE_MANUAL},
+        {"shutter",  V4L2_EXPOSURE_SHUTTER_PRIORITY},
+        {"aperture", V4L2_EXPOSURE_APERTURE_PRIORITY},
+    }, power_line_frequencies[] = {
+        {"disabled", V4L2_CID_POWER_LINE_FREQUENCY_DISABLED},
+        {"50",       V4L2_CID_POWER_LINE_FREQUENCY_50HZ},
+        {"60",       V4L2_CID_POWER_LINE_FREQUENCY_60HZ},
+        {"auto",     V4L2_CID_POWER_LINE_FREQUENCY_AUTO},
+    };
+
+    copy = strdup(str);
+    if (NULL == copy) {
+        fprintf(stderr, "strdup() failed\n");
+        return -1;
+    }
+
+    for (token = strtok_r(copy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        char* value = strchr(token, '=');
+        size_t i;
+
+        if (value)
+            *value++ = '\0';
+
+        if (0 == strcmp(token, "lock-fps")) {
+            profile->lock_fps = true;
+            continue;
+        }
+
+        if (NULL == value || *value == '\0') {
+            fprintf(stderr, "control '%s' requires a value\n", token);
+            break;
+        }
+
+        if (0 == strcmp(token, "exposure")) {
+            for (i = 0; i < (sizeof(exposure_modes) / sizeof(exposure_modes[0])); ++i)
+                if (0 == strcmp(value, exposure_modes[i].name))
+                    break;
+            if (i == (sizeof(exposure_modes) / sizeof(exposure_modes[0]))) {
+                fprintf(stderr, "unknown exposure mode '%s'\n", value);
+                break;
+            }
+            profile->exposure_auto = exposure_modes[i].value;
+        } else
+        if (0 == strcmp(token, "power-line")) {
+            for (i = 0; i < (sizeof(power_line_frequencies) / sizeof(power_line_frequencies[0])); ++i)
+                if (0 == strcmp(value, power_line_frequencies[i].name))
+                    break;
+            if (i == (sizeof(power_line_frequencies) / sizeof(power_line_frequencies[0]))) {
+                fprintf(stderr, "unknown power line frequency '%s'\n", value);
+                break;
+            }
+            profile->power_line_frequency = power_line_frequencies[i].value;
+        } else
+        if (0 == strcmp(token, "exposure-time"))
+            profile->exposure_absolute = atoi(value);
+        else
+        if (0 == strcmp(token, "auto-priority"))
+            profile->exposure_auto_priority = atoi(value);
+        else
+        if (0 == strcmp(token, "gain"))
+            profile->gain = atoi(value);
+        else {
+            fprintf(stderr, "unknown control '%s'\n", token);
+            break;
+        }
+    }
+
+    if (NULL == token)
+        retval = 0;
+
+    free(copy);
+
+    return retval;
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
+static const char* v4l2_capabilities_to_string(char* buf, size_t size, uint32_t capabilities)
+{
+    size_t i;
+    int n;
+    char *p = buf;
+
+    static const char* caps[] = {
+        "V4L2_CAP_VIDEO_CAPTURE",
+        "V4L2_CAP_VIDEO_OUTPUT",
+        "V4L2_CAP_VIDEO_OVERLAY",
+        "UNKNOWN_0x00000008",
+        "V4L2_CAP_VBI_CAPTURE",
+        "V4L2_CAP_VBI_OUTPUT",
+        "V4L2_CAP_SLICED_VBI_CAPTURE",
+        "V4L2_CAP_SLICED_VBI_OUTPUT",
+        "V4L2_CAP_RDS_CAPTURE",
+        "V4L2_CAP_VIDEO_OUTPUT_OVERLAY",
+        "V4L2_CAP_HW_FREQ_SEEK",
+        "V4L2_CAP_RDS_OUTPUT",
+        "V4L2_CAP_VIDEO_CAPTURE_MPLANE",
+        "V4L2_CAP_VIDEO_OUTPUT_MPLANE",
+        "V4L2_CAP_VIDEO_M2M_MPLANE",
+        "V4L2_CAP_VIDEO_M2M",
+        "V4L2_CAP_TUNER",
+        "V4L2_CAP_AUDIO",
+        "V4L2_CAP_RADIO",
+        "V4L2_CAP_MODULATOR",
+        "V4L2_CAP_SDR_CAPTURE",
+        "V4L2_CAP_EXT_PIX_FORMAT",
+        "V4L2_CAP_SDR_OUTPUT",
+        "V4L2_CAP_META_CAPTURE",
+        "V4L2_CAP_READWRITE",
+        "V4L2_CAP_ASYNCIO",
+        "V4L2_CAP_STREAMING",
+        "V4L2_CAP_META_OUTPUT",
+        "V4L2_CAP_TOUCH",
+        "UNKNOWN_0x20000000",
+        "UNKNOWN_0x40000000",
+        "V4L2_CAP_DEVICE_CAPS",
+    };
+
+    memset(p, 0, size);
+
+    for (i = 0; i < (sizeof(caps) / sizeof(caps[0])); ++i)
+        if (capabilities & (1U << i)) {
+            n = snprintf(p, size, "\t\t%s\n", caps[i]);
+            if (n < 0)
+                return NULL;
+            if ((size_t)n >= size)
+                break;
+            p += n;
+            size -= n;
+        }
+
+    return buf;
+}
+
+static const char* v4l2_buf_type_to_string(enum v4l2_buf_type buf_type)
+{
+    static const char* buf_types[] = {
+        [0]                                  = "0",
+        [V4L2_BUF_TYPE_VIDEO_CAPTURE]        = "V4L2_BUF_TYPE_VIDEO_CAPTURE",
+        [V4L2_BUF_TYPE_VIDEO_OVERLAY]        = "V4L2_BUF_TYPE_VIDEO_OVERLAY",
+        [V4L2_BUF_TYPE_VIDEO_OUTPUT]         = "V4L2_BUF_TYPE_VIDEO_OUTPUT",
+        [V4L2_BUF_TYPE_VBI_CAPTURE]          = "V4L2_BUF_TYPE_VBI_CAPTURE",
+        [V4L2_BUF_TYPE_VBI_OUTPUT]           = "V4L2_BUF_TYPE_VBI_OUTPUT",
+        [V4L2_BUF_TYPE_SLICED_VBI_CAPTURE]   = "V4L2_BUF_TYPE_SLICED_VBI_CAPTURE",
+        [V4L2_BUF_TYPE_SLICED_VBI_OUTPUT]    = "V4L2_BUF_TYPE_SLICED_VBI_OUTPUT",
+        [V4L2_BUF_TYPE_VIDEO_OUTPUT_OVERLAY] = "V4L2_BUF_TYPE_VIDEO_OUTPUT_OVERLAY",
+        [V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE] = "V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE",
+        [V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE]  = "V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE",
+        [V4L2_BUF_TYPE_SDR_CAPTURE]          = "V4L2_BUF_TYPE_SDR_CAPTURE",
+        [V4L2_BUF_TYPE_SDR_OUTPUT]           = "V4L2_BUF_TYPE_SDR_OUTPUT",
+    };
+
+    if (buf_type > (sizeof(buf_types) / sizeof(buf_types[0])))
+        buf_type = 0;
+
+    return buf_types[buf_type];
+}
+
+static const char* v4l2_frmsizetype_to_string(enum v4l2_frmsizetypes type)
+{
+    static const char* types[] = {
+        [0]                              = "0",
+        [V4L2_FRMSIZE_TYPE_DISCRETE]     = "V4L2_FRMSIZE_TYPE_DISCRETE",
+        [V4L2_FRMSIZE_TYPE_CONTINUOUS]   = "V4L2_FRMSIZE_TYPE_CONTINUOUS",
+        [V4L2_FRMSIZE_TYPE_STEPWISE]     = "V4L2_FRMSIZE_TYPE_STEPWISE",
+    };
+
+    if (type >= (sizeof(types) / sizeof(types[0])))
+        type = 0;
+
+    return types[type];
+}
+
+static const char* v4l2_frmivaltype_to_string(enum v4l2_frmivaltypes type)
+{
+    static const char* types[] = {
+        [0]                              = "0",
+        [V4L2_FRMIVAL_TYPE_DISCRETE]     = "V4L2_FRMIVAL_TYPE_DISCRETE",
+        [V4L2_FRMIVAL_TYPE_CONTINUOUS]   = "V4L2_FRMIVAL_TYPE_CONTINUOUS",
+        [V4L2_FRMIVAL_TYPE_STEPWISE]     = "V4L2_FRMIVAL_TYPE_STEPWISE",
+    };
+
+    if (type >= (sizeof(types) / sizeof(types[0])))
+        type = 0;
+
+    return types[type];
+}
+
+static void v4l2_print_capabilities(const struct v4l2_capability* caps)
+{
+    char buf1[1024];
+    char buf2[1024];
+
+    fprintf(stdout,
+        "VIDIOC_QUERYCAP:\n"
+        "\tdriver       : %s\n"
+        "\tcard         : %s\n"
+        "\tbus_info     : %s\n"
+        "\tversion      : 0x%08x\n"
+        "\tcapabilities : 0x%08x\n"
+        "%s"
+        "\tdevice_caps  : 0x%08x\n"
+        "%s",
+        caps->driver,
+        caps->card,
+        caps->bus_info,
+        caps->version,
+        caps->capabilities,
+        v4l2_capabilities_to_string(buf1, sizeof(buf1), caps->capabilities),
+        caps->device_caps,
+        v4l2_capabilities_to_string(buf2, sizeof(buf2), caps->device_caps)
+        );
+}
+
+static void v4l2_print_fmtdesc(const struct v4l2_fmtdesc* fmtdesc)
+{
+    fprintf(stdout,
+        "VIDIOC_ENUM_FMT:\n"
+        "\tindex       : %u\n"
+        "\ttype        : %s\n"
+        "\tflags       : 0x%08x\n"
+        "\tdescription : %s\n"
+        "\tpixelformat : '%c%c%c%c'\n",
+        fmtdesc->index,
+        v4l2_buf_type_to_string(fmtdesc->type),
+        fmtdesc->flags,
+        fmtdesc->description,
+        (fmtdesc->pixelformat >>  0) & 0xff,
+        (fmtdesc->pixelformat >>  8) & 0xff,
+        (fmtdesc->pixelformat >> 16) & 0xff,
+        (fmtdesc->pixelformat >> 24) & 0xff
+        );
+}
+
+static void v4l2_print_frmsizeenum(const struct v4l2_frmsizeenum* frmsizeenum)
+{
+    fprintf(stdout,
+        "\tVIDIOC_ENUM_FRAMESIZES:\n"
+        "\t\tindex       : %u\n"
+        "\t\tpixelformat : '%c%c%c%c'\n"
+        "\t\ttype        : %s\n",
+        frmsizeenum->index,
+        (frmsizeenum->pixel_format >>  0) & 0xff,
+        (frmsizeenum->pixel_format >>  8) & 0xff,
+        (frmsizeenum->pixel_format >> 16) & 0xff,
+        (frmsizeenum->pixel_format >> 24) & 0xff,
+        v4l2_frmsizetype_to_string(frmsizeenum->type)
+        );
+
+    if (frmsizeenum->type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+        fprintf(stdout,
+            "\t\tdiscrete    : width: %u, height: %u\n",
+            frmsizeenum->discrete.width,
+            frmsizeenum->discrete.height
+            );
+    } else
+    if (frmsizeenum->type == V4L2_FRMSIZE_TYPE_STEPWISE) {
+
+    } else {
+        /* do nothing */
+    }
+}
+
+static void v4l2_print_frmivalenum(const struct v4l2_frmivalenum* frmivalenum)
+{
+    fprintf(stdout,
+        "\t\tVIDIOC_ENUM_FRAMEINTERVALS:\n"
+        "\t\t\tindex       : %u\n"
+        "\t\t\tpixelformat : '%c%c%c%c'\n"
+        "\t\t\twidth       : %u\n"
+        "\t\t\theight      : %u\n"
+        "\t\t\ttype        : %s\n",
+        frmivalenum->index,
+        (frmivalenum->pixel_format >>  0) & 0xff,
+        (frmivalenum->pixel_format >>  8) & 0xff,
+        (frmivalenum->pixel_format >> 16) & 0xff,
+        (frmivalenum->pixel_format >> 24) & 0xff,
+        frmivalenum->width,
+        frmivalenum->height,
+        v4l2_frmivaltype_to_string(frmivalenum->type)
+        );
+
+        if (frmivalenum->type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+            fprintf(stdout,
+                "\t\t\tdiscrete    : %u/%u\n",
+                frmivalenum->discrete.numerator,
+                frmivalenum->discrete.denominator
+                );
+        } else
+        if (frmivalenum->type == V4L2_FRMSIZE_TYPE_STEPWISE) {
+            fprintf(stdout,
+                "\t\t\tstepwise    : min: %u/%u, max: %u/%u, step: %u/%u\n",
+                frmivalenum->stepwise.min.numerator,
+                frmivalenum->stepwise.min.denominator,
+                frmivalenum->stepwise.max.numerator,
+                frmivalenum->stepwise.max.denominator,
+                frmivalenum->stepwise.step.numerator,
+                frmivalenum->stepwise.step.denominator
+                );
+        } else {
+            /* do nothing */
+        }
+}
+
+static void v4l2_print_cropping_capabilities(const struct v4l2_cropcap* cropcap)
+{
+    fprintf(stdout,
+        "VIDIOC_CROPCAP:\n"
+        "\tbounds      : left: %d, top: %d, width: %u, height: %u\n"
+        "\tdefrect     : left: %d, top: %d, width: %u, height: %u\n"
+        "\tpixelaspect : numerator: %u, denominator: %u\n",
+        cropcap->bounds.left, cropcap->bounds.top, cropcap->bounds.width, cropcap->bounds.height,
+        cropcap->defrect.left, cropcap->defrect.top, cropcap->defrect.width, cropcap->defrect.height,
+        cropcap->pixelaspect.numerator, cropcap->pixelaspect.denominator
+        );
+}
+
+static void v4l2_print_format(const struct v4l2_format* format)
+{
+    fprintf(stdout,
+        "selected frame format:\n"
+        "\ttype        : %s\n"
+        "\tdiscrete    : width: %u, height: %u\n"
+        "\tpixelformat : '%c%c%c%c'\n",
+        v4l2_buf_type_to_string(format->type),
+        format->fmt.pix.width,
+        format->fmt.pix.height,
+        (format->fmt.pix.pixelformat >>  0) & 0xff,
+        (format->fmt.pix.pixelformat >>  8) & 0xff,
+        (format->fmt.pix.pixelformat >> 16) & 0xff,
+        (format->fmt.pix.pixelformat >> 24) & 0xff
+        );
+}
+
+static const char* v4l2_ctrl_type_to_string(uint32_t type)
+{
+    static const char* types[] = {
+        [0]                              = "0",
+        [V4L2_CTRL_TYPE_INTEGER]         = "V4L2_CTRL_TYPE_INTEGER",
+        [V4L2_CTRL_TYPE_BOOLEAN]         = "V4L2_CTRL_TYPE_BOOLEAN",
+        [V4L2_CTRL_TYPE_MENU]            = "V4L2_CTRL_TYPE_MENU",
+        [V4L2_CTRL_TYPE_BUTTON]          = "V4L2_CTRL_TYPE_BUTTON",
+        [V4L2_CTRL_TYPE_INTEGER64]       = "V4L2_CTRL_TYPE_INTEGER64",
+        [V4L2_CTRL_TYPE_CTRL_CLASS]      = "V4L2_CTRL_TYPE_CTRL_CLASS",
+        [V4L2_CTRL_TYPE_STRING]          = "V4L2_CTRL_TYPE_STRING",
+        [V4L2_CTRL_TYPE_BITMASK]         = "V4L2_CTRL_TYPE_BITMASK",
+        [V4L2_CTRL_TYPE_INTEGER_MENU]    = "V4L2_CTRL_TYPE_INTEGER_MENU",
+    };
+
+    if (type >= V4L2_CTRL_COMPOUND_TYPES)
+        return "V4L2_CTRL_COMPOUND_TYPES";
+
+    if (type >= (sizeof(types) / sizeof(types[0])))
+        type = 0;
+
+    return types[type];
+}
+
+static void v4l2_print_query_ext_ctrl(const struct v4l2_query_ext_ctrl* qctrl)
+{
+    fprintf(stdout,
+        "VIDIOC_QUERY_EXT_CTRL:\n"
+        "\tid          : 0x%08x\n"
+        "\tname        : %s\n"
+        "\ttype        : %s\n"
+        "\tflags       : 0x%08x\n",
+        qctrl->id,
+        qctrl->name,
+        v4l2_ctrl_type_to_string(qctrl->type),
+        qctrl->flags
+        );
+
+    if (qctrl->type != V4L2_CTRL_TYPE_CTRL_CLASS) {
+        fprintf(stdout,
+            "\trange       : min: %" PRId64 ", max: %" PRId64 ", step: %" PRIu64 ", default: %" PRId64 "\n",
+            (int64_t)qctrl->minimum,
+            (int64_t)qctrl->maximum,
+            (uint64_t)qctrl->step,
+            (int64_t)qctrl->default_value
+            );
+    }
+}
+
+static void v4l2_print_querymenu(const struct v4l2_querymenu* querymenu, uint32_t type)
+{
+    if (type == V4L2_CTRL_TYPE_INTEGER_MENU)
+        fprintf(stdout,
+            "\tVIDIOC_QUERYMENU:\n"
+            "\t\tindex       : %u\n"
+            "\t\tvalue       : %" PRId64 "\n",
+            querymenu->index,
+            (int64_t)querymenu->value
+            );
+    else
+        fprintf(stdout,
+            "\tVIDIOC_QUERYMENU:\n"
+            "\t\tindex       : %u\n"
+            "\t\tname        : %s\n",
+            querymenu->index,
+            querymenu->name
+            );
+}
+
+static uint32_t v4l2_query_capabilities(struct v4l2_capture* ctx, uint32_t flags)
+{
+    int fd = ctx->fd;
+
+    uint32_t capabilities = 0;
+
+    do {
+        int status;
+        struct v4l2_capability caps;
+        struct v4l2_fmtdesc fmtdesc;
+        struct v4l2_cropcap cropcap;
+        struct v4l2_frmsizeenum frmsizeenum;
+        struct v4l2_frmivalenum frmivalenum;
+
+        memset(&caps, 0, sizeof(caps));
+        status = ioctl(fd, VIDIOC_QUERYCAP, &caps);
+        if (-1 == status) {
+            fprintf(stderr, "VIDIOC_QUERYCAP failed: %s\n", strerror(errno));
+            break;
+        }
+
+        capabilities = caps.capabilities;
+        if (ctx->verbose)
+            v4l2_print_capabilities(&caps);
+
+        memset(&fmtdesc, 0, sizeof(fmtdesc));
+        fmtdesc.index = 0;
+        fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        for (; 0 == (status = ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc)); fmtdesc.index++) {
+            if (ctx->verbose)
+                v4l2_print_fmtdesc(&fmtdesc);
+
+            memset(&frmsizeenum, 0, sizeof(frmsizeenum));
+            frmsizeenum.index = 0;
+            frmsizeenum.pixel_format = fmtdesc.pixelformat;
+            for (; 0 == (status = ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmsizeenum)); frmsizeenum.index++) {
+                if (V4L2_FRMSIZE_TYPE_DISCRETE == frmsizeenum.type) {
+                    if (ctx->verbose)
+                        v4l2_print_frmsizeenum(&frmsizeenum);
+
+                    if (ctx->selected_format.type == 0) {
+                        if ((flags ^ fmtdesc.flags) == 0) {
+                            ctx->selected_format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                            ctx->selected_format.fmt.pix.width = frmsizeenum.discrete.width;
+                            ctx->selected_format.fmt.pix.height = frmsizeenum.discrete.height;
+                            ctx->selected_format.fmt.pix.pixelformat = frmsizeenum.pixel_format;
+                        }
+                    }
+
+                    memset(&frmivalenum, 0, sizeof(frmivalenum));
+                    frmivalenum.index = 0;
+                    frmivalenum.pixel_format = frmsizeenum.pixel_format;
+                    frmivalenum.width = frmsizeenum.discrete.width;
+                    frmivalenum.height = frmsizeenum.discrete.height;
+                    for (; 0 == (status = ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmivalenum)); frmivalenum.index++)
+                        if (ctx->verbose)
+                            v4l2_print_frmivalenum(&frmivalenum);
+                    if (-1 == status && errno != EINVAL)
+                        fprintf(stderr, "VIDIOC_ENUM_FRAMEINTERVALS failed: %s\n", strerror(errno));
+                }
+            }
+            if (-1 == status && errno != EINVAL)
+                fprintf(stderr, "VIDIOC_ENUM_FRAMESIZES failed: %s\n", strerror(errno));
+        }
+        if (-1 == status && errno != EINVAL)
+            fprintf(stderr, "VIDIOC_ENUM_FMT failed: %s\n", strerror(errno));
+
+        memset(&cropcap, 0, sizeof(cropcap));
+        cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        status = ioctl(fd, VIDIOC_CROPCAP, &cropcap);
+        if (-1 == status) {
+            fprintf(stderr, "VIDIOC_CROPCAP failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (ctx->verbose)
+            v4l2_print_cropping_capabilities(&cropcap);
+    } while (0);
+
+    return capabilities;
+}
+
+static int v4l2_query_buffers(struct v4l2_capture* ctx, int number_of_buffers)
+{
+    int retval = -1;
+
+    do {
+        struct v4l2_requestbuffers requestbuffers;
+        uint32_t i;
+
+        memset(&requestbuffers, 0, sizeof(requestbuffers));
+        requestbuffers.count = number_of_buffers;
+        requestbuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        requestbuffers.memory = V4L2_MEMORY_MMAP;
+
+        if (-1 == ioctl(ctx->fd, VIDIOC_REQBUFS, &requestbuffers)) {
+            fprintf(stderr, "VIDIOC_REQBUFS failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (ctx->verbose)
+            fprintf(stdout,
+                "VIDIOC_REQBUFS:\n"
+                "\trequested count: %u, commited count: %u\n",
+                number_of_buffers, requestbuffers.count
+                );
+
+        ctx->buffer_descriptors = calloc(requestbuffers.count, sizeof(*ctx->buffer_descriptors));
+        if (NULL == ctx->buffer_descriptors) {
+            fprintf(stderr, "calloc(%u, %zu) failed\n",
+                requestbuffers.count, sizeof(*ctx->buffer_descriptors));
+            break;
+        }
+
+        for (i = 0; i < requestbuffers.count; ++i) {
+            struct v4l2_buffer buffer;
+            struct v4l2_buffer_descriptor* bd;
+            void* addr;
+
+            memset(&buffer, 0, sizeof(buffer));
+            buffer.index = i;
+            buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buffer.memory = V4L2_MEMORY_MMAP;
+            if(-1 == ioctl(ctx->fd, VIDIOC_QUERYBUF, &buffer)) {
+                fprintf(stderr, "VIDIOC_QUERYBUF[%d] failed: %s\n", i, strerror(errno));
+                break;
+            }
+
+            if (ctx->verbose)
+                fprintf(stdout,
+                    "VIDIOC_QUERYBUF[%u]:\n"
+                    "\tlength: %u, offset: %u\n",
+                    i, buffer.length, buffer.m.offset
+                    );
+
+            addr = mmap(
+                NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd, buffer.m.offset);
+            if (MAP_FAILED == addr) {
+                fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
+                break;
+            }
+
+            bd = ctx->buffer_descriptors + i;
+            bd->index = i;
+            bd->addr = addr;
+            bd->size = buffer.length;
+            bd->offset = buffer.m.offset;
+            ctx->number_of_buffers = i + 1;
+        }
+
+        if (i < requestbuffers.count)
+            break;
+
+        retval = requestbuffers.count;
+    } while (0);
+
+    if (retval < 0)
+        v4l2_unmap_buffers(ctx);
+
+    return retval;
+}
+
+static void v4l2_unmap_buffers(struct v4l2_capture* ctx)
+{
+    struct v4l2_requestbuffers requestbuffers;
+    int i;
+
+    if (NULL == ctx->buffer_descriptors)
+        return;
+
+    for (i = 0; i < ctx->number_of_buffers; ++i)
+        munmap(ctx->buffer_descriptors[i].addr, ctx->buffer_descriptors[i].size);
+
+    /* free driver side buffers too, so that the format can be changed again */
+    memset(&requestbuffers, 0, sizeof(requestbuffers));
+    requestbuffers.count = 0;
+    requestbuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    requestbuffers.memory = V4L2_MEMORY_MMAP;
+    if (-1 == ioctl(ctx->fd, VIDIOC_REQBUFS, &requestbuffers))
+        fprintf(stderr, "VIDIOC_REQBUFS(0) failed: %s\n", strerror(errno));
+
+    free(ctx->buffer_descriptors);
+    ctx->buffer_descriptors = NULL;
+    ctx->number_of_buffers = 0;
+}
+
+static int v4l2_queue_buffers(struct v4l2_capture* ctx)
+{
+    int retval = -1;
+
+    do {
+        int i;
+
+        for (i = 0; i < ctx->number_of_buffers; ++i) {
+            struct v4l2_buffer buffer;
+
+            memset(&buffer, 0, sizeof(buffer));
+            buffer.index = i;
+            buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buffer.memory = V4L2_MEMORY_MMAP;
+            if(-1 == ioctl(ctx->fd, VIDIOC_QBUF, &buffer)) {
+                fprintf(stderr, "VIDIOC_QBUF[%d] failed: %s\n", i, strerror(errno));
+                break;
+            }
+        }
+
+        if (i < ctx->number_of_buffers)
+            break;
+
+        retval = 0;
+    } while (0);
+
+    return retval;
+}
+
+static uint64_t v4l2_query_frame_interval(struct v4l2_capture* ctx)
+{
+    uint64_t frame_interval_ns = 0;
+
+    do {
+        struct v4l2_streamparm streamparm;
+        const struct v4l2_fract* tpf;
+
+        memset(&streamparm, 0, sizeof(streamparm));
+        streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+        if (-1 == ioctl(ctx->fd, VIDIOC_G_PARM, &streamparm)) {
+            fprintf(stderr, "VIDIOC_G_PARM failed: %s\n", strerror(errno));
+            break;
+        }
+
+        tpf = &streamparm.parm.capture.timeperframe;
+
+        if (ctx->verbose)
+            fprintf(stdout,
+                "VIDIOC_G_PARM:\n"
+                "\ttimeperframe: %u/%u\n",
+                tpf->numerator, tpf->denominator
+                );
+
+        if (tpf->denominator == 0)
+            break;
+
+        frame_interval_ns = (uint64_t)tpf->numerator * 1000000000ULL / tpf->denominator;
+    } while (0);
+
+    return frame_interval_ns;
+}
+
+static void v4l2_query_controls(struct v4l2_capture* ctx)
+{
+    struct v4l2_query_ext_ctrl qctrl;
+    struct v4l2_querymenu querymenu;
+    int64_t index;
+    int status;
+
+    memset(&qctrl, 0, sizeof(qctrl));
+    qctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+    for (; 0 == (status = ioctl(ctx->fd, VIDIOC_QUERY_EXT_CTRL, &qctrl));
+           qctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND) {
+        v4l2_print_query_ext_ctrl(&qctrl);
+
+        if (qctrl.type != V4L2_CTRL_TYPE_MENU && qctrl.type != V4L2_CTRL_TYPE_INTEGER_MENU)
+            continue;
+
+        /* menus may have holes, so every index within the range has to be tried */
+        for (index = qctrl.minimum; index <= qctrl.maximum; ++index) {
+            memset(&querymenu, 0, sizeof(querymenu));
+            querymenu.id = qctrl.id;
+            querymenu.index = index;
+            if (0 == ioctl(ctx->fd, VIDIOC_QUERYMENU, &querymenu))
+                v4l2_print_querymenu(&querymenu, qctrl.type);
+        }
+    }
+    if (-1 == status && errno != EINVAL)
+        fprintf(stderr, "VIDIOC_QUERY_EXT_CTRL failed: %s\n", strerror(errno));
+}
+
+static int v4l2_set_frame_rate(struct v4l2_capture* ctx, uint32_t frame_rate)
+{
+    struct v4l2_streamparm streamparm;
+
+    memset(&streamparm, 0, sizeof(streamparm));
+    streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    streamparm.parm.capture.timeperframe.numerator = 1;
+    streamparm.parm.capture.timeperframe.denominator = frame_rate;
+
+    if (-1 == ioctl(ctx->fd, VIDIOC_S_PARM, &streamparm)) {
+        fprintf(stderr, "VIDIOC_S_PARM failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (ctx->verbose)
+        fprintf(stdout,
+            "VIDIOC_S_PARM:\n"
+            "\trequested   : 1/%u\n"
+            "\ttimeperframe: %u/%u\n",
+            frame_rate,
+            streamparm.parm.capture.timeperframe.numerator,
+            streamparm.parm.capture.timeperframe.denominator
+            );
+
+    return 0;
+}
+
+static int v4l2_apply_controls(struct v4l2_capture* ctx, const struct v4l2_capture_control_profile* profile)
+{
+    int retval = -1;
+
+    do {
+        struct v4l2_ext_controls ext_ctrls;
+        struct v4l2_ext_control ctrls[V4L2_MAX_PROFILE_CONTROLS];
+        struct v4l2_query_ext_ctrl qctrls[V4L2_MAX_PROFILE_CONTROLS];
+        struct v4l2_capture_control_profile p = *profile;
+        uint32_t count = 0;
+        uint32_t i;
+        int64_t max_exposure = INT64_MAX;
+
+        /* order matters: exposure mode has to be applied before the exposure time */
+        const struct {
+            uint32_t id;
+            int32_t* value;
+        } entries[V4L2_MAX_PROFILE_CONTROLS] = {
+            {V4L2_CID_EXPOSURE_AUTO,          &p.exposure_auto},
+            {V4L2_CID_EXPOSURE_AUTO_PRIORITY, &p.exposure_auto_priority},
+            {V4L2_CID_EXPOSURE_ABSOLUTE,      &p.exposure_absolute},
+            {V4L2_CID_GAIN,                   &p.gain},
+            {V4L2_CID_POWER_LINE_FREQUENCY,   &p.power_line_frequency},
+        };
+
+        if (p.lock_fps) {
+            /* auto exposure must not be allowed to lower the frame rate */
+            if (p.exposure_auto_priority == V4L2_CAPTURE_CONTROL_UNSET)
+                p.exposure_auto_priority = 0;
+
+            if (ctx->frame_interval_ns > 0) {
+                /* V4L2_CID_EXPOSURE_ABSOLUTE is expressed in 100 us units */
+                max_exposure = ctx->frame_interval_ns / 100000;
+
+                if (p.exposure_absolute == V4L2_CAPTURE_CONTROL_UNSET) {
+                    struct v4l2_control control;
+                    int32_t exposure_auto = p.exposure_auto;
+
+                    memset(&control, 0, sizeof(control));
+                    control.id = V4L2_CID_EXPOSURE_AUTO;
+                    if (exposure_auto == V4L2_CAPTURE_CONTROL_UNSET && 0 == ioctl(ctx->fd, VIDIOC_G_CTRL, &control))
+                        exposure_auto = control.value;
+
+                    /* current exposure time matters only when it is not under auto exposure control */
+                    if (exposure_auto == V4L2_EXPOSURE_MANUAL || exposure_auto == V4L2_EXPOSURE_SHUTTER_PRIORITY) {
+                        memset(&control, 0, sizeof(control));
+                        control.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+                        if (0 == ioctl(ctx->fd, VIDIOC_G_CTRL, &control) && control.value > max_exposure)
+                            p.exposure_absolute = (int32_t)max_exposure;
+                    }
+                } else
+                if (p.exposure_absolute > max_exposure)
+                    p.exposure_absolute = (int32_t)max_exposure;
+            }
+        }
+
+        memset(ctrls, 0, sizeof(ctrls));
+        for (i = 0; i < V4L2_MAX_PROFILE_CONTROLS; ++i) {
+            struct v4l2_query_ext_ctrl* qctrl = qctrls + count;
+            int64_t value;
+
+            if (*entries[i].value == V4L2_CAPTURE_CONTROL_UNSET)
+                continue;
+
+            memset(qctrl, 0, sizeof(*qctrl));
+            qctrl->id = entries[i].id;
+            if (-1 == ioctl(ctx->fd, VIDIOC_QUERY_EXT_CTRL, qctrl)) {
+                fprintf(stderr, "control 0x%08x is not supported, skipped\n", entries[i].id);
+                continue;
+            }
+
+            if (qctrl->flags & (V4L2_CTRL_FLAG_DISABLED | V4L2_CTRL_FLAG_READ_ONLY)) {
+                fprintf(stderr, "control '%s' cannot be set, skipped\n", qctrl->name);
+                continue;
+            }
+
+            value = *entries[i].value;
+            if (value < qctrl->minimum)
+                value = qctrl->minimum;
+            if (value > qctrl->maximum)
+                value = qctrl->maximum;
+
+            /* drivers reject values which are not a multiple of step away from the minimum,
+               rounding up must neither exceed the maximum nor the exposure limit of lock-fps */
+            if (qctrl->step > 1) {
+                value = qctrl->minimum + ((value - qctrl->minimum) + (int64_t)(qctrl->step / 2)) /
+                    (int64_t)qctrl->step * (int64_t)qctrl->step;
+                if (value > qctrl->maximum ||
+                    (entries[i].id == V4L2_CID_EXPOSURE_ABSOLUTE && value > max_exposure &&
+                     value - (int64_t)qctrl->step >= qctrl->minimum))
+                    value -= qctrl->step;
+            }
+
+            /* menus may have holes, an invalid index would fail the whole batch */
+            if (qctrl->type == V4L2_CTRL_TYPE_MENU || qctrl->type == V4L2_CTRL_TYPE_INTEGER_MENU) {
+                struct v4l2_querymenu querymenu;
+
+                memset(&querymenu, 0, sizeof(querymenu));
+                querymenu.id = qctrl->id;
+                querymenu.index = (uint32_t)value;
+                if (-1 == ioctl(ctx->fd, VIDIOC_QUERYMENU, &querymenu)) {
+                    fprintf(stderr, "control '%s' does not support menu index %" PRId64 ", skipped\n",
+                        qctrl->name, value);
+                    continue;
+                }
+            }
+
+            ctrls[count].id = entries[i].id;
+            ctrls[count].value = (int32_t)value;
+            count++;
+        }
+
+        if (count == 0) {
+            retval = 0;
+            break;
+        }
+
+        memset(&ext_ctrls, 0, sizeof(ext_ctrls));
+        ext_ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+        ext_ctrls.count = count;
+        ext_ctrls.controls = ctrls;
+
+        if (-1 == ioctl(ctx->fd, VIDIOC_S_EXT_CTRLS, &ext_ctrls)) {
+            fprintf(stderr, "VIDIOC_S_EXT_CTRLS failed: %s (error_idx: %u)\n",
+                strerror(errno), ext_ctrls.error_idx);
+            if (ext_ctrls.error_idx < count)
+                fprintf(stderr, "\tcontrol '%s', value: %d\n",
+                    qctrls[ext_ctrls.error_idx].name, ctrls[ext_ctrls.error_idx].value);
+            break;
+        }
+
+        if (ctx->verbose) {
+            fprintf(stdout, "VIDIOC_S_EXT_CTRLS:\n");
+            for (i = 0; i < count; ++i)
+                fprintf(stdout, "\t%-32s: %d\n", qctrls[i].name, ctrls[i].value);
+        }
+
+        retval = 0;
+    } while (0);
+
+    return retval;
+}
+
+static void v4l2_update_frame_rate(struct v4l2_capture* ctx, const struct v4l2_capture_frame* frame)
+{
+    uint64_t elapsed;
+    uint32_t frames;
+    uint64_t deviation;
+    bool deviates;
+
+    if (ctx->window_frames++ == 0) {
+        ctx->window_start_ns = frame->dequeue_time_ns;
+        ctx->window_start_sequence = frame->sequence;
+        return;
+    }
+
+    elapsed = frame->dequeue_time_ns - ctx->window_start_ns;
+    if (elapsed < V4L2_FRAME_RATE_WINDOW_NS)
+        return;
+
+    /* sequence numbers account for frames dropped by the driver, not all drivers fill them in */
+    frames = frame->sequence - ctx->window_start_sequence;
+    if (frames == 0)
+        frames = ctx->window_frames - 1;
+
+    ctx->measured_interval_ns = elapsed / frames;
+    ctx->window_start_ns = frame->dequeue_time_ns;
+    ctx->window_start_sequence = frame->sequence;
+    ctx->window_frames = 1;
+
+    if (ctx->frame_interval_ns == 0)
+        return;
+
+    deviation = ctx->measured_interval_ns > ctx->frame_interval_ns ?
+        ctx->measured_interval_ns - ctx->frame_interval_ns :
+        ctx->frame_interval_ns - ctx->measured_interval_ns;
+    deviates = deviation * 100 > ctx->frame_interval_ns * V4L2_CAPTURE_FRAME_RATE_TOLERANCE_PERCENT;
+
+    /* report transitions only, so a lasting deviation does not flood the output */
+    if (deviates && !ctx->frame_rate_deviates)
+        fprintf(stderr, "measured frame interval %" PRIu64 " us deviates from target %" PRIu64 " us\n",
+            ctx->measured_interval_ns / 1000, ctx->frame_interval_ns / 1000);
+    else
+    if (!deviates && ctx->frame_rate_deviates)
+        fprintf(stderr, "measured frame interval %" PRIu64 " us is back at target %" PRIu64 " us\n",
+            ctx->measured_interval_ns / 1000, ctx->frame_interval_ns / 1000);
+
+    ctx->frame_rate_deviates = deviates;
+}
+
+static int v4l2_rt_setup(struct v4l2_capture* ctx, const struct v4l2_capture_rt_config* config)
+{
+    uint64_t frame_interval_ns = ctx->frame_interval_ns;
+
+    int retval = -1;
+
+    do {
+        /* SCHED_DEADLINE tasks must be allowed to run on their whole root domain */
+        if (config->cpu >= 0 && config->policy == V4L2_CAPTURE_RT_POLICY_DEADLINE) {
+            fprintf(stderr, "SCHED_DEADLINE cannot be combined with cpu pinning, "
+                "use an exclusive cpuset (root domain) to restrict it to given cpus\n");
+            break;
+        }
+
+        if (-1 == mlockall(MCL_CURRENT | MCL_FUTURE)) {
+            fprintf(stderr, "mlockall() failed: %s\n", strerror(errno));
+            break;
+        }
+
+        /* grow the stack once now, so page faults do not happen later during capturing */
+        {
+            volatile uint8_t stack[V4L2_RT_PREFAULT_STACK_SIZE];
+            size_t i;
+
+            for (i = 0; i < sizeof(stack); i += sysconf(_SC_PAGESIZE))
+                stack[i] = 0;
+        }
+
+        if (config->cpu >= 0) {
+            cpu_set_t cpuset;
+
+            CPU_ZERO(&cpuset);
+            CPU_SET(config->cpu, &cpuset);
+
+            if (-1 == sched_setaffinity(0, sizeof(cpuset), &cpuset)) {
+                fprintf(stderr, "sched_setaffinity(%d) failed: %s\n", config->cpu, strerror(errno));
+                break;
+            }
+        }
+
+        if (config->policy == V4L2_CAPTURE_RT_POLICY_FIFO) {
+            struct sched_param param;
+
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = config->priority;
+
+            if (-1 == sched_setscheduler(0, SCHED_FIFO, &param)) {
+                fprintf(stderr, "sched_setscheduler(SCHED_FIFO, %d) failed: %s\n",
+                    config->priority, strerror(errno));
+                break;
+            }
+        } else
+        if (config->policy == V4L2_CAPTURE_RT_POLICY_DEADLINE) {
+            struct v4l2_sched_attr attr;
+
+            if (frame_interval_ns == 0) {
+                fprintf(stderr, "SCHED_DEADLINE requires a known frame interval\n");
+                break;
+            }
+
+            /* one activation per frame, budget of half of the frame interval */
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.sched_policy = SCHED_DEADLINE;
+            attr.sched_runtime = frame_interval_ns / 2;
+            attr.sched_deadline = frame_interval_ns;
+            attr.sched_period = frame_interval_ns;
+
+            if (-1 == syscall(SYS_sched_setattr, 0, &attr, 0)) {
+                fprintf(stderr, "sched_setattr(SCHED_DEADLINE) failed: %s\n", strerror(errno));
+                break;
+            }
+        } else {
+            /* do nothing */
+        }
+
+        if (ctx->verbose)
+            fprintf(stdout,
+                "real-time mode:\n"
+                "\tpolicy       : %s\n"
+                "\tpriority     : %d\n"
+                "\tcpu          : %d\n",
+                config->policy == V4L2_CAPTURE_RT_POLICY_DEADLINE ? "SCHED_DEADLINE" :
+                config->policy == V4L2_CAPTURE_RT_POLICY_FIFO ? "SCHED_FIFO" : "none",
+                config->policy == V4L2_CAPTURE_RT_POLICY_FIFO ? config->priority : 0,
+                config->cpu
+                );
+
+        retval = 0;
+    } while (0);
+
+    return retval;
+}
+
+static void v4l2_rt_prefault_buffers(struct v4l2_capture* ctx)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    int i;
+
+    for (i = 0; i < ctx->number_of_buffers; ++i) {
+        struct v4l2_buffer_descriptor* bd = ctx->buffer_descriptors + i;
+        volatile const uint8_t* p = bd->addr;
+        size_t offset;
+
+        /* device mappings are not always covered by mlockall(), so lock them explicitly */
+        if (-1 == mlock(bd->addr, bd->size))
+            fprintf(stderr, "mlock(buffer[%d]) failed: %s\n", i, strerror(errno));
+
+        for (offset = 0; offset < bd->size; offset += pagesize)
+            (void)p[offset];
+    }
+}
+
+static int v4l2_replay_add_frame(struct v4l2_capture* ctx, const struct v4l2_replay_frame* frame)
+{
+    /* grow by powers of two, frames are added only while opening the replay source */
+    if ((ctx->replay_number_of_frames & (ctx->replay_number_of_frames - 1)) == 0) {
+        size_t capacity = ctx->replay_number_of_frames ? 2 * (size_t)ctx->replay_number_of_frames : 1;
+        struct v4l2_replay_frame* frames;
+
+        frames = realloc(ctx->replay_frames, capacity * sizeof(*frames));
+        if (NULL == frames) {
+            fprintf(stderr, "realloc(%zu) failed\n", capacity * sizeof(*frames));
+            return -1;
+        }
+        ctx->replay_frames = frames;
+    }
+
+    ctx->replay_frames[ctx->replay_number_of_frames++] = *frame;
+
+    return 0;
+}
+
+static int v4l2_replay_add_file(struct v4l2_capture* ctx, const char* filename,
+    const struct v4l2_capture_replay_config* config)
+{
+    int retval = -1;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (-1 == fd) {
+        fprintf(stderr, "cannot open '%s': %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    do {
+        struct stat st;
+        struct v4l2_replay_mapping* mappings;
+        struct v4l2_replay_frame frame;
+        struct v4l2_replay_frame_header header;
+        const uint8_t* addr;
+        size_t size;
+
+        if (-1 == fstat(fd, &st)) {
+            fprintf(stderr, "fstat('%s') failed: %s\n", filename, strerror(errno));
+            break;
+        }
+
+        size = st.st_size;
+        if (size == 0) {
+            fprintf(stderr, "'%s' is empty\n", filename);
+            break;
+        }
+
+        addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == addr) {
+            fprintf(stderr, "mmap('%s') failed: %s\n", filename, strerror(errno));
+            break;
+        }
+
+        mappings = realloc(ctx->replay_mappings,
+            (ctx->replay_number_of_mappings + 1) * sizeof(*mappings));
+        if (NULL == mappings) {
+            fprintf(stderr, "realloc() failed\n");
+            munmap((void*)addr, size);
+            break;
+        }
+        ctx->replay_mappings = mappings;
+        ctx->replay_mappings[ctx->replay_number_of_mappings].addr = (void*)addr;
+        ctx->replay_mappings[ctx->replay_number_of_mappings].size = size;
+        ctx->replay_mappings[ctx->replay_number_of_mappings].dev = st.st_dev;
+        ctx->replay_mappings[ctx->replay_number_of_mappings].ino = st.st_ino;
+        ctx->replay_number_of_mappings++;
+
+        memset(&header, 0, sizeof(header));
+        if (size >= sizeof(header))
+            memcpy(&header, addr, sizeof(header));
+
+        if (header.magic == V4L2_REPLAY_FRAME_MAGIC) {
+            /* recorded stream: sequence of headers, each followed by frame data */
+            size_t offset = 0;
+
+            while (offset < size) {
+                if (size - offset < sizeof(header)) {
+                    fprintf(stderr, "'%s': truncated frame header at offset %zu\n", filename, offset);
+                    break;
+                }
+
+                memcpy(&header, addr + offset, sizeof(header));
+                if (header.magic != V4L2_REPLAY_FRAME_MAGIC ||
+                    header.size > size - offset - sizeof(header)) {
+                    fprintf(stderr, "'%s': corrupted frame at offset %zu\n", filename, offset);
+                    break;
+                }
+
+                frame.data = addr + offset + sizeof(header);
+                frame.size = header.size;
+                frame.fourcc = header.fourcc;
+                frame.width = header.width;
+                frame.height = header.height;
+                frame.bytesperline = header.bytesperline;
+                frame.timestamp_ns = header.timestamp_ns;
+                if (v4l2_replay_add_frame(ctx, &frame))
+                    break;
+
+                offset += sizeof(header) + header.size;
+            }
+
+            if (offset != size)
+                break;
+        } else {
+            /* imageNNNN.<fourcc> file: a single frame, written when it was captured */
+            const char* ext = strrchr(filename, '.');
+            uint32_t bpp;
+
+            if (NULL == ext || strlen(ext + 1) != 4) {
+                fprintf(stderr, "'%s': fourcc cannot be deduced from the file name\n", filename);
+                break;
+            }
+
+            frame.data = addr;
+            frame.size = size;
+            frame.fourcc = v4l2_fourcc(ext[1], ext[2], ext[3], ext[4]);
+            frame.width = config->width;
+            frame.height = config->height;
+            bpp = frame.fourcc == V4L2_PIX_FMT_YUYV ? 2 :
+                  frame.fourcc == V4L2_PIX_FMT_NV12 || frame.fourcc == V4L2_PIX_FMT_GREY ? 1 : 0;
+            frame.bytesperline = config->width * bpp;
+            frame.timestamp_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+            if (v4l2_replay_add_frame(ctx, &frame))
+                break;
+        }
+
+        retval = 0;
+    } while (0);
+
+    close(fd);
+
+    return retval;
+}
+
+static int v4l2_replay_find_segments(struct v4l2_capture* ctx)
+{
+    const struct v4l2_replay_frame* frames = ctx->replay_frames;
+    uint64_t* deltas;
+    int n = 0;
+    int i;
+
+    deltas = calloc(ctx->replay_number_of_frames, sizeof(*deltas));
+    if (NULL == deltas) {
+        fprintf(stderr, "calloc(%d, %zu) failed\n", ctx->replay_number_of_frames, sizeof(*deltas));
+        return -1;
+    }
+
+    for (i = 1; i < ctx->replay_number_of_frames; ++i)
+        if (frames[i].timestamp_ns > frames[i - 1].timestamp_ns)
+            deltas[n++] = frames[i].timestamp_ns - frames[i - 1].timestamp_ns;
+
+    if (n > 0) {
+        qsort(deltas, n, sizeof(*deltas), v4l2_replay_compare_u64);
+        ctx->replay_interval_ns = deltas[n / 2];
+    }
+
+    free(deltas);
+
+    /* timestamps going back (e.g. recorded after a reboot) or jumping far ahead start a new session */
+    ctx->replay_frames[0].segment_start = true;
+    for (i = 1; i < ctx->replay_number_of_frames; ++i)
+        ctx->replay_frames[i].segment_start = frames[i].timestamp_ns < frames[i - 1].timestamp_ns ||
+            frames[i].timestamp_ns - frames[i - 1].timestamp_ns >
+                V4L2_REPLAY_SEGMENT_GAP_FACTOR * ctx->replay_interval_ns;
+
+    return 0;
+}
+
+static int v4l2_replay_compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t v4l2_replay_frame_interval(const struct v4l2_capture* ctx)
+{
+    /* there is no target to compare with when frames are pushed as fast as possible */
+    return ctx->replay_paced ? ctx->replay_interval_ns : 0;
+}
+
+static int v4l2_replay_acquire_frame(struct v4l2_capture* ctx, struct v4l2_capture_frame* frame)
+{
+    const struct v4l2_replay_frame* rf;
+    struct timespec ts;
+    uint64_t now;
+
+    if (ctx->replay_position == ctx->replay_number_of_frames) {
+        if (ctx->replay_loops > 0 && ctx->replay_loop + 1 >= ctx->replay_loops)
+            return V4L2_CAPTURE_END_OF_STREAM;
+
+        ctx->replay_position = 0;
+        ctx->replay_loop++;
+    }
+
+    rf = ctx->replay_frames + ctx->replay_position;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    if (ctx->replay_paced && ctx->replay_base_ns != 0) {
+        /* frames keep their distance to the first one of their session,
+           a new session follows the previous frame after a typical interval */
+        uint64_t due = rf->segment_start ?
+            ctx->replay_last_ns + ctx->replay_interval_ns :
+            ctx->replay_base_ns + (rf->timestamp_ns - ctx->replay_segment_ns);
+
+        if (due > now) {
+            ts.tv_sec = due / 1000000000ULL;
+            ts.tv_nsec = due % 1000000000ULL;
+            while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+                ;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+    }
+
+    if (rf->segment_start || ctx->replay_base_ns == 0) {
+        ctx->replay_base_ns = now;
+        ctx->replay_segment_ns = rf->timestamp_ns;
+    }
+    ctx->replay_last_ns = now;
+
+    if (ctx->verbose_frames)
+        fprintf(stdout,
+            "REPLAY[%d]:\n"
+            "\tbytesused: %zu\n",
+            ctx->replay_position, rf->size
+            );
+
+    memset(frame, 0, sizeof(*frame));
+    frame->index = ctx->replay_position;
+    frame->data = rf->data;
+    frame->size = rf->size;
+    frame->fourcc = rf->fourcc;
+    frame->width = rf->width;
+    frame->height = rf->height;
+    frame->bytesperline = rf->bytesperline;
+    frame->sequence = ctx->replay_sequence++;
+    frame->timestamp.tv_sec = rf->timestamp_ns / 1000000000ULL;
+    frame->timestamp.tv_usec = (rf->timestamp_ns % 1000000000ULL) / 1000;
+    frame->dequeue_time_ns = now;
+
+    ctx->replay_position++;
+
+    v4l2_update_frame_rate(ctx, frame);
+
+    return 0;
+}
+
+static void v4l2_replay_close(struct v4l2_capture* ctx)
+{
+    int i;
+
+    for (i = 0; i < ctx->replay_number_of_mappings; ++i)
+        munmap(ctx->replay_mappings[i].addr, ctx->replay_mappings[i].size);
+
+    free(ctx->replay_mappings);
+    free(ctx->replay_frames);
+}
@@ -0,0 +1,166 @@
+/**
+ * @file v4l2_capture.h
+ *
+ * Public interface of libv4l2capture - small library wrapping basic v4l2 streaming
+ * (mmap) video capture behind a context handle.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _V4L2_CAPTURE_H_
+#define _V4L2_CAPTURE_H_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <sys/time.h>
+
+#include <linux/videodev2.h>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define V4L2_CAPTURE_RT_DEFAULT_PRIORITY 50
+
+/* value of a control profile entry which is to be left as configured in the device */
+#define V4L2_CAPTURE_CONTROL_UNSET INT32_MIN
+
+/* measured frame interval may differ that much from the target before it is reported */
+#define V4L2_CAPTURE_FRAME_RATE_TOLERANCE_PERCENT 10
+
+/* returned by v4l2_capture_acquire_frame() once a replay source has no more frames */
+#define V4L2_CAPTURE_END_OF_STREAM 1
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+struct v4l2_capture;
+
+enum v4l2_capture_rt_policy
+{
+    V4L2_CAPTURE_RT_POLICY_NONE,
+    V4L2_CAPTURE_RT_POLICY_FIFO,
+    V4L2_CAPTURE_RT_POLICY_DEADLINE,
+};
+
+struct v4l2_capture_rt_config
+{
+    bool enabled;                        /* lock and prefault memory, apply policy and affinity */
+    enum v4l2_capture_rt_policy policy;
+    int priority;                        /* SCHED_FIFO priority */
+    int cpu;                             /* cpu to pin the calling thread to, -1 for no pinning */
+};
+
+struct v4l2_capture_control_profile
+{
+    int32_t exposure_auto;               /* V4L2_CID_EXPOSURE_AUTO, one of enum v4l2_exposure_auto_type */
+    int32_t exposure_absolute;           /* V4L2_CID_EXPOSURE_ABSOLUTE, in 100 us units */
+    int32_t exposure_auto_priority;      /* V4L2_CID_EXPOSURE_AUTO_PRIORITY, 0 keeps the frame rate constant */
+    int32_t gain;                        /* V4L2_CID_GAIN */
+    int32_t power_line_frequency;        /* V4L2_CID_POWER_LINE_FREQUENCY, one of enum v4l2_power_line_frequency */
+    bool lock_fps;                       /* never let exposure stretch the negotiated frame interval */
+};
+
+struct v4l2_capture_config
+{
+    int number_of_buffers;
+    bool use_compressed_formats;
+    bool verbose;                        /* print queried capabilities and per frame information (not in rt mode) to stdout */
+    uint32_t frame_rate;                 /* frames per second requested with VIDIOC_S_PARM, 0 to keep the driver default */
+    const struct v4l2_capture_control_profile* controls; /* applied atomically before streaming, NULL to leave controls alone */
+    struct v4l2_capture_rt_config rt;
+};
+
+struct v4l2_capture_replay_config
+{
+    const char* const* filenames;        /* imageNNNN.<fourcc> files and/or streams written with v4l2_capture_record_frame() */
+    int number_of_files;
+    uint32_t width;                      /* geometry of image files, which do not carry it, 0 if unknown */
+    uint32_t height;
+    int loops;                           /* number of passes over all frames, <= 0 to loop forever */
+    bool paced;                          /* deliver frames at their original intervals (per recording session) instead of as fast as possible */
+};
+
+struct v4l2_capture_frame
+{
+    int index;                           /* buffer index, identifies the frame in v4l2_capture_release_frame() */
+    const void* data;                    /* points directly into the mmap'd capture buffer */
+    size_t size;                         /* bytesused */
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesperline;
+    uint32_t sequence;
+    uint32_t flags;
+    struct timeval timestamp;            /* driver timestamp */
+    uint64_t dequeue_time_ns;            /* CLOCK_MONOTONIC time of VIDIOC_DQBUF */
+};
+
+/**
+ * Returns 0 to continue capturing or non-zero to stop v4l2_capture_run().
+ * The frame is valid only for the duration of the call.
+ */
+typedef int (*v4l2_capture_callback)(struct v4l2_capture* ctx,
+    const struct v4l2_capture_frame* frame, void* user);
+
+/*===========================================================================*\
+ * global (external linkage) object declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * function forward declarations (external linkage)
+\*===========================================================================*/
+struct v4l2_capture* v4l2_capture_open(const char* filename);
+struct v4l2_capture* v4l2_capture_open_replay(const struct v4l2_capture_replay_config* config);
+void v4l2_capture_close(struct v4l2_capture* ctx);
+
+int v4l2_capture_configure(struct v4l2_capture* ctx, const struct v4l2_capture_config* config);
+int v4l2_capture_start(struct v4l2_capture* ctx);
+int v4l2_capture_stop(struct v4l2_capture* ctx);
+
+int v4l2_capture_acquire_frame(struct v4l2_capture* ctx, struct v4l2_capture_frame* frame);
+int v4l2_capture_release_frame(struct v4l2_capture* ctx, const struct v4l2_capture_frame* frame);
+
+/* returns -1 when the stream broke, 0 when it ended or the callback asked to stop */
+int v4l2_capture_run(struct v4l2_capture* ctx, int number_of_frames,
+    v4l2_capture_callback callback, void* user);
+
+int v4l2_capture_record_frame(int fd, const struct v4l2_capture_frame* frame);
+
+/* replayed files are mapped, writing to any of them corrupts the frames being replayed */
+bool v4l2_capture_is_replay_source(const struct v4l2_capture* ctx, int fd);
+
+void v4l2_capture_control_profile_init(struct v4l2_capture_control_profile* profile);
+int v4l2_capture_control_profile_parse(struct v4l2_capture_control_profile* profile, const char* str);
+
+const struct v4l2_format* v4l2_capture_get_format(const struct v4l2_capture* ctx);
+uint64_t v4l2_capture_get_frame_interval(const struct v4l2_capture* ctx);
+uint64_t v4l2_capture_get_measured_frame_interval(const struct v4l2_capture* ctx);
+int v4l2_capture_get_number_of_buffers(const struct v4l2_capture* ctx);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* _V4L2_CAPTURE_H_ */
@@ -0,0 +1,452 @@
+/**
+ * @file v4l2_pyramid.c
+ *
+ * Thumbnail pyramid built straight from the capture buffer.
+ * Every level is a 2x2 box filtered (which at exactly half scale is the same as
+ * bilinear filtering at pixel centres) copy of the previous one, kept in the
+ * pixel format of the source frame.
+ * Levels are produced in a single pass over the source: as soon as two rows of
+ * a level are ready, the row of the next level is computed from them, while they
+ * are still in cache.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <linux/videodev2.h>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+#include "v4l2_pyramid.h"
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local type definitions
+\*===========================================================================*/
+/* computes 'units' output units of a row from two consecutive source rows */
+typedef void (*v4l2_downscale_row)(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, uint32_t units);
+
+struct v4l2_plane_desc
+{
+    const uint8_t* data;
+    uint32_t bytesperline;
+    uint32_t rows;
+    uint32_t units;
+};
+
+struct v4l2_pyramid
+{
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesperline;
+    int number_of_levels;
+    struct v4l2_pyramid_level levels[V4L2_PYRAMID_MAX_LEVELS];
+};
+
+/*===========================================================================*\
+ * global object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * local function declarations
+\*===========================================================================*/
+static void v4l2_downscale_grey_row(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, uint32_t units);
+static void v4l2_downscale_yuyv_row(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, uint32_t units);
+static void v4l2_downscale_uv_row(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, uint32_t units);
+static void v4l2_pyramid_cascade(struct v4l2_plane_desc* planes, int number_of_levels,
+    int level, uint32_t row, v4l2_downscale_row downscale);
+static void v4l2_pyramid_build_plane(struct v4l2_plane_desc* planes, int number_of_levels,
+    v4l2_downscale_row downscale);
+
+/*===========================================================================*\
+ * local object definitions
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * inline function definitions
+\*===========================================================================*/
+#if defined(__SSE2__)
+/* vertical sums of 8 consecutive bytes of two rows, widened to 16 bits */
+static inline __m128i v4l2_vsum_lo(__m128i a, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    return _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+}
+
+static inline __m128i v4l2_vsum_hi(__m128i a, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    return _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+}
+
+/*
+ * v holds vertical sums of Y0 U0 Y1 V0 Y2 U1 Y3 V1,
+ * low 64 bits of the result hold Y0+Y1, U0+U1, Y2+Y3, V0+V1.
+ */
+static inline __m128i v4l2_hsum_yuyv(__m128i v)
+{
+    const __m128i mask = _mm_set1_epi32(0x0000ffff);
+    __m128i p = _mm_add_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128i q = _mm_add_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    p = _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 2, 2, 0));
+
+    return _mm_or_si128(_mm_and_si128(p, mask), _mm_andnot_si128(mask, q));
+}
+
+/*
+ * v holds vertical sums of U0 V0 U1 V1 U2 V2 U3 V3,
+ * low 64 bits of the result hold U0+U1, V0+V1, U2+U3, V2+V3.
+ */
+static inline __m128i v4l2_hsum_uv(__m128i v)
+{
+    __m128i p = _mm_add_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 2, 2, 0));
+}
+
+/* rounded average of 4 samples, 16 output bytes out of 2 x 32 input bytes */
+static inline __m128i v4l2_box_yuyv(const uint8_t* src0, const uint8_t* src1)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    __m128i a0 = _mm_loadu_si128((const __m128i*)src0);
+    __m128i b0 = _mm_loadu_si128((const __m128i*)src1);
+    __m128i a1 = _mm_loadu_si128((const __m128i*)(src0 + 16));
+    __m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + 16));
+    __m128i r0 = _mm_unpacklo_epi64(v4l2_hsum_yuyv(v4l2_vsum_lo(a0, b0)), v4l2_hsum_yuyv(v4l2_vsum_hi(a0, b0)));
+    __m128i r1 = _mm_unpacklo_epi64(v4l2_hsum_yuyv(v4l2_vsum_lo(a1, b1)), v4l2_hsum_yuyv(v4l2_vsum_hi(a1, b1)));
+
+    r0 = _mm_srli_epi16(_mm_add_epi16(r0, two), 2);
+    r1 = _mm_srli_epi16(_mm_add_epi16(r1, two), 2);
+
+    return _mm_packus_epi16(r0, r1);
+}
+
+static inline __m128i v4l2_box_uv(const uint8_t* src0, const uint8_t* src1)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    __m128i a0 = _mm_loadu_si128((const __m128i*)src0);
+    __m128i b0 = _mm_loadu_si128((const __m128i*)src1);
+    __m128i a1 = _mm_loadu_si128((const __m128i*)(src0 + 16));
+    __m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + 16));
+    __m128i r0 = _mm_unpacklo_epi64(v4l2_hsum_uv(v4l2_vsum_lo(a0, b0)), v4l2_hsum_uv(v4l2_vsum_hi(a0, b0)));
+    __m128i r1 = _mm_unpacklo_epi64(v4l2_hsum_uv(v4l2_vsum_lo(a1, b1)), v4l2_hsum_uv(v4l2_vsum_hi(a1, b1)));
+
+    r0 = _mm_srli_epi16(_mm_add_epi16(r0, two), 2);
+    r1 = _mm_srli_epi16(_mm_add_epi16(r1, two), 2);
+
+    return _mm_packus_epi16(r0, r1);
+}
+
+static inline __m128i v4l2_box_grey(const uint8_t* src0, const uint8_t* src1)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    __m128i a0 = _mm_loadu_si128((const __m128i*)src0);
+    __m128i b0 = _mm_loadu_si128((const __m128i*)src1);
+    __m128i a1 = _mm_loadu_si128((const __m128i*)(src0 + 16));
+    __m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + 16));
+    __m128i r0 = _mm_add_epi16(
+        _mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+        _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+    __m128i r1 = _mm_add_epi16(
+        _mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+        _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+
+    r0 = _mm_srli_epi16(_mm_add_epi16(r0, two), 2);
+    r1 = _mm_srli_epi16(_mm_add_epi16(r1, two), 2);
+
+    return _mm_packus_epi16(r0, r1);
+}
+#endif
+
+static inline uint8_t v4l2_box(const uint8_t* src0, const uint8_t* src1, int a, int b)
+{
+    return (src0[a] + src0[b] + src1[a] + src1[b] + 2) >> 2;
+}
+
+/*===========================================================================*\
+ * public function definitions
+\*===========================================================================*/
+bool v4l2_pyramid_is_supported(uint32_t fourcc)
+{
+    return fourcc == V4L2_PIX_FMT_YUYV ||
+           fourcc == V4L2_PIX_FMT_NV12 ||
+           fourcc == V4L2_PIX_FMT_GREY;
+}
+
+struct v4l2_pyramid* v4l2_pyramid_create(uint32_t fourcc, uint32_t width, uint32_t height,
+    uint32_t bytesperline, int number_of_levels)
+{
+    struct v4l2_pyramid* pyramid;
+    uint32_t w = width;
+    uint32_t h = height;
+    uint32_t bpp = fourcc == V4L2_PIX_FMT_YUYV ? 2 : 1;
+    int i;
+
+    if (!v4l2_pyramid_is_supported(fourcc)) {
+        fprintf(stderr, "pixel format '%c%c%c%c' is not supported by the pyramid\n",
+            (fourcc >>  0) & 0xff,
+            (fourcc >>  8) & 0xff,
+            (fourcc >> 16) & 0xff,
+            (fourcc >> 24) & 0xff
+            );
+        return NULL;
+    }
+
+    if (number_of_levels < 1 || number_of_levels > V4L2_PYRAMID_MAX_LEVELS) {
+        fprintf(stderr, "number of pyramid levels must be within 1..%d\n", V4L2_PYRAMID_MAX_LEVELS);
+        return NULL;
+    }
+
+    pyramid = calloc(1, sizeof(*pyramid));
+    if (NULL == pyramid) {
+        fprintf(stderr, "calloc(1, %zu) failed\n", sizeof(*pyramid));
+        return NULL;
+    }
+
+    pyramid->fourcc = fourcc;
+    pyramid->width = width;
+    pyramid->height = height;
+    pyramid->bytesperline = bytesperline ? bytesperline : width * bpp;
+
+    for (i = 0; i < number_of_levels; ++i) {
+        struct v4l2_pyramid_level* level = pyramid->levels + i;
+
+        /* chroma is shared by 2 horizontal (YUYV, NV12) and 2 vertical (NV12) pixels */
+        w = fourcc == V4L2_PIX_FMT_GREY ? w / 2 : (w / 2) & ~1U;
+        h = fourcc == V4L2_PIX_FMT_NV12 ? (h / 2) & ~1U : h / 2;
+        if (w == 0 || h == 0) {
+            fprintf(stderr, "frame %ux%u is too small for pyramid scale 1/%u and smaller, those levels are not built\n",
+                width, height, 2U << i);
+            break;
+        }
+
+        level->scale = 2U << i;
+        level->fourcc = fourcc;
+        level->width = w;
+        level->height = h;
+        level->bytesperline = w * bpp;
+        level->size = (size_t)level->bytesperline * h;
+        if (fourcc == V4L2_PIX_FMT_NV12)
+            level->size += level->size / 2;
+
+        level->data = malloc(level->size);
+        if (NULL == level->data) {
+            fprintf(stderr, "malloc(%zu) failed\n", level->size);
+            v4l2_pyramid_destroy(pyramid);
+            return NULL;
+        }
+
+        pyramid->number_of_levels = i + 1;
+    }
+
+    if (pyramid->number_of_levels == 0) {
+        fprintf(stderr, "frame %ux%u is too small for a pyramid\n", width, height);
+        v4l2_pyramid_destroy(pyramid);
+        return NULL;
+    }
+
+    return pyramid;
+}
+
+void v4l2_pyramid_destroy(struct v4l2_pyramid* pyramid)
+{
+    int i;
+
+    if (NULL == pyramid)
+        return;
+
+    for (i = 0; i < pyramid->number_of_levels; ++i)
+        free((void*)pyramid->levels[i].data);
+
+    free(pyramid);
+}
+
+int v4l2_pyramid_build(struct v4l2_pyramid* pyramid, uint32_t fourcc, uint32_t width, uint32_t height,
+    const void* data, size_t size)
+{
+    struct v4l2_plane_desc planes[V4L2_PYRAMID_MAX_LEVELS + 1];
+    size_t luma_size = (size_t)pyramid->bytesperline * pyramid->height;
+    size_t expected_size = pyramid->fourcc == V4L2_PIX_FMT_NV12 ? luma_size + luma_size / 2 : luma_size;
+    int i;
+
+    if (fourcc != pyramid->fourcc || width != pyramid->width || height != pyramid->height) {
+        fprintf(stderr, "frame '%c%c%c%c' %ux%u does not match pyramid '%c%c%c%c' %ux%u\n",
+            (fourcc >>  0) & 0xff,
+            (fourcc >>  8) & 0xff,
+            (fourcc >> 16) & 0xff,
+            (fourcc >> 24) & 0xff,
+            width, height,
+            (pyramid->fourcc >>  0) & 0xff,
+            (pyramid->fourcc >>  8) & 0xff,
+            (pyramid->fourcc >> 16) & 0xff,
+            (pyramid->fourcc >> 24) & 0xff,
+            pyramid->width, pyramid->height
+            );
+        return -1;
+    }
+
+    if (size < expected_size) {
+        fprintf(stderr, "frame of %zu bytes is too short, %zu bytes expected\n", size, expected_size);
+        return -1;
+    }
+
+    /* luma (or packed YUYV) plane */
+    planes[0].data = data;
+    planes[0].bytesperline = pyramid->bytesperline;
+    planes[0].rows = pyramid->height;
+    for (i = 0; i < pyramid->number_of_levels; ++i) {
+        const struct v4l2_pyramid_level* level = pyramid->levels + i;
+
+        planes[i + 1].data = level->data;
+        planes[i + 1].bytesperline = level->bytesperline;
+        planes[i + 1].rows = level->height;
+        planes[i + 1].units = pyramid->fourcc == V4L2_PIX_FMT_YUYV ? level->width / 2 : level->width;
+    }
+
+    v4l2_pyramid_build_plane(planes, pyramid->number_of_levels,
+        pyramid->fourcc == V4L2_PIX_FMT_YUYV ? v4l2_downscale_yuyv_row : v4l2_downscale_grey_row);
+
+    if (pyramid->fourcc != V4L2_PIX_FMT_NV12)
+        return 0;
+
+    /* interleaved chroma plane of NV12, follows luma with the same bytesperline */
+    planes[0].data = (const uint8_t*)data + luma_size;
+    planes[0].rows = pyramid->height / 2;
+    for (i = 0; i < pyramid->number_of_levels; ++i) {
+        const struct v4l2_pyramid_level* level = pyramid->levels + i;
+
+        planes[i + 1].data = level->data + (size_t)level->bytesperline * level->height;
+        planes[i + 1].rows = level->height / 2;
+        planes[i + 1].units = level->width / 2;
+    }
+
+    v4l2_pyramid_build_plane(planes, pyramid->number_of_levels, v4l2_downscale_uv_row);
+
+    return 0;
+}
+
+int v4l2_pyramid_get_number_of_levels(const struct v4l2_pyramid* pyramid)
+{
+    return pyramid->number_of_levels;
+}
+
+const struct v4l2_pyramid_level* v4l2_pyramid_get_level(const struct v4l2_pyramid* pyramid, int level)
+{
+    if (level < 0 || level >= pyramid->number_of_levels)
+        return NULL;
+
+    return pyramid->levels + level;
+}
+
+/*===========================================================================*\
+ * local function definitions
+\*===========================================================================*/
+static void v4l2_downscale_grey_row(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, uint32_t units)
+{
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= units; i += 16)
+        _mm_storeu_si128((__m128i*)(dst + i), v4l2_box_grey(src0 + 2 * i, src1 + 2 * i));
+#endif
+
+    for (; i < units; ++i)
+        dst[i] = v4l2_box(src0 + 2 * i, src1 + 2 * i, 0, 1);
+}
+
+/* one unit is a Y0 U Y1 V macropixel, made of two source macropixels */
+static void v4l2_downscale_yuyv_row(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, uint32_t units)
+{
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 4 <= units; i += 4)
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), v4l2_box_yuyv(src0 + 8 * i, src1 + 8 * i));
+#endif
+
+    for (; i < units; ++i) {
+        const uint8_t* s0 = src0 + 8 * i;
+        const uint8_t* s1 = src1 + 8 * i;
+        uint8_t* d = dst + 4 * i;
+
+        d[0] = v4l2_box(s0, s1, 0, 2);
+        d[1] = v4l2_box(s0, s1, 1, 5);
+        d[2] = v4l2_box(s0, s1, 4, 6);
+        d[3] = v4l2_box(s0, s1, 3, 7);
+    }
+}
+
+/* one unit is an interleaved U V pair */
+static void v4l2_downscale_uv_row(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, uint32_t units)
+{
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 8 <= units; i += 8)
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), v4l2_box_uv(src0 + 4 * i, src1 + 4 * i));
+#endif
+
+    for (; i < units; ++i) {
+        const uint8_t* s0 = src0 + 4 * i;
+        const uint8_t* s1 = src1 + 4 * i;
+        uint8_t* d = dst + 2 * i;
+
+        d[0] = v4l2_box(s0, s1, 0, 2);
+        d[1] = v4l2_box(s0, s1, 1, 3);
+    }
+}
+
+static void v4l2_pyramid_cascade(struct v4l2_plane_desc* planes, int number_of_levels,
+    int level, uint32_t row, v4l2_downscale_row downscale)
+{
+    const struct v4l2_plane_desc* src = planes + level - 1;
+    const struct v4l2_plane_desc* dst = planes + level;
+
+    downscale((uint8_t*)dst->data + (size_t)row * dst->bytesperline,
+        src->data + (size_t)(2 * row + 0) * src->bytesperline,
+        src->data + (size_t)(2 * row + 1) * src->bytesperline,
+        dst->units);
+
+    /* second of a pair of rows is done, next level row can be computed while both are hot */
+    if (level < number_of_levels && (row & 1) && (row >> 1) < planes[level + 1].rows)
+        v4l2_pyramid_cascade(planes, number_of_levels, level + 1, row >> 1, downscale);
+}
+
+static void v4l2_pyramid_build_plane(struct v4l2_plane_desc* planes, int number_of_levels,
+    v4l2_downscale_row downscale)
+{
+    uint32_t row;
+
+    for (row = 0; row < planes[1].rows; ++row)
+        v4l2_pyramid_cascade(planes, number_of_levels, 1, row, downscale);
+}
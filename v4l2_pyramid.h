@@ -0,0 +1,82 @@
+/**
+ * @file v4l2_pyramid.h
+ *
+ * Thumbnail pyramid (1/2, 1/4, 1/8, ... scale) built straight from
+ * YUYV, NV12 or GREY capture buffers.
+ *
+ * @author Lukasz Wiecaszek <lukasz.wiecaszek@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+
+#ifndef _V4L2_PYRAMID_H_
+#define _V4L2_PYRAMID_H_
+
+/*===========================================================================*\
+ * system header files
+\*===========================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*===========================================================================*\
+ * project header files
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * preprocessor #define constants and macros
+\*===========================================================================*/
+#define V4L2_PYRAMID_MAX_LEVELS 8
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*===========================================================================*\
+ * global type definitions
+\*===========================================================================*/
+struct v4l2_pyramid;
+
+struct v4l2_pyramid_level
+{
+    uint32_t scale;                      /* 2 for 1/2, 4 for 1/4, ... */
+    uint32_t fourcc;                     /* same as the fourcc of the source frame */
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesperline;
+    size_t size;
+    const uint8_t* data;
+};
+
+/*===========================================================================*\
+ * global (external linkage) object declarations
+\*===========================================================================*/
+
+/*===========================================================================*\
+ * function forward declarations (external linkage)
+\*===========================================================================*/
+bool v4l2_pyramid_is_supported(uint32_t fourcc);
+
+struct v4l2_pyramid* v4l2_pyramid_create(uint32_t fourcc, uint32_t width, uint32_t height,
+    uint32_t bytesperline, int number_of_levels);
+void v4l2_pyramid_destroy(struct v4l2_pyramid* pyramid);
+
+/* frames of other format or geometry than the pyramid was created for are rejected */
+int v4l2_pyramid_build(struct v4l2_pyramid* pyramid, uint32_t fourcc, uint32_t width, uint32_t height,
+    const void* data, size_t size);
+
+int v4l2_pyramid_get_number_of_levels(const struct v4l2_pyramid* pyramid);
+const struct v4l2_pyramid_level* v4l2_pyramid_get_level(const struct v4l2_pyramid* pyramid, int level);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* _V4L2_PYRAMID_H_ */
@@ -17,42 +17,50 @@
  * See the GNU General Public License for more details.
  */
 
+
 /*===========================================================================*\
  * system header files
 \*===========================================================================*/
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <getopt.h>
-
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-
-#include <linux/videodev2.h>
+#include <time.h>
 
 /*===========================================================================*\
  * project header files
 \*===========================================================================*/
+#include "v4l2_capture.h"
+#include "v4l2_pyramid.h"
 
 /*===========================================================================*\
  * preprocessor #define constants and macros
 \*===========================================================================*/
-#define V4l2_SELECT_TIMEOUT_SEC 10
 
 /*===========================================================================*\
  * local type definitions
 \*===========================================================================*/
-struct v4l2_buffer_descriptor
+struct v4l2_capture_state
 {
-    int index;
-    void* addr;
-    size_t size;
-    uint32_t offset;
+    int counter;
+    uint64_t* timestamps;
+    int max_timestamps;
+    int record_fd;                       /* stream written with v4l2_capture_record_frame(), -1 if none */
+    uint64_t bytes;                      /* processing statistics, for throughput and latency reporting */
+    uint64_t first_dequeue_time_ns;
+    uint64_t last_done_time_ns;
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+    struct v4l2_pyramid* pyramid;
+    uint32_t pyramid_levels;             /* bit n set: store level n, i.e. 1/(2 << n) scale */
+    bool store_frames;
+    const char* prefix;                  /* of stored file names, replayed frames must not overwrite their sources */
 };
 
 /*===========================================================================*\
@@ -63,28 +71,17 @@ struct v4l2_buffer_descriptor
  * local function declarations
 \*===========================================================================*/
 static void v4l2_print_usage(const char* progname);
-static const char* v4l2_capabilities_to_string(char* buf, size_t size, uint32_t capabilities);
-static const char* v4l2_buf_type_to_string(enum v4l2_buf_type buf_type);
-static const char* v4l2_frmsizetype_to_string(enum v4l2_frmsizetypes type);
-static const char* v4l2_frmivaltype_to_string(enum v4l2_frmivaltypes type);
-static void v4l2_print_capabilities(const struct v4l2_capability* caps);
-static void v4l2_print_fmtdesc(const struct v4l2_fmtdesc* fmtdesc);
-static void v4l2_print_frmsizeenum(const struct v4l2_frmsizeenum* frmsizeenum);
-static void v4l2_print_frmivalenum(const struct v4l2_frmivalenum* frmivalenum);
-static void v4l2_print_cropping_capabilities(const struct v4l2_cropcap* cropcap);
-static void v4l2_print_format(const struct v4l2_format* format);
-static uint32_t v4l2_query_capabilities(int fd, uint32_t flags);
-static int v4l2_query_buffers(int fd, int number_of_buffers);
-static int v4l2_queue_buffers(int fd, int number_of_buffers);
-static int v4l2_capture_frame(int fd, void** frame_buffer, size_t* frame_size);
-static void v4l2_store_frame(const uint8_t* image, uint32_t fourcc, size_t size, int counter);
-static int v4l2_video_capture(int fd, int number_of_frames);
+static int v4l2_compare_u64(const void* a, const void* b);
+static void v4l2_print_jitter(const uint64_t* timestamps, int count, uint64_t frame_interval_ns);
+static int v4l2_parse_pyramid_levels(const char* str, uint32_t* levels);
+static void v4l2_store_frame(const struct v4l2_capture* ctx, const char* prefix,
+    const uint8_t* image, uint32_t fourcc, size_t size, int counter, uint32_t scale);
+static void v4l2_print_processing_statistics(const struct v4l2_capture_state* state);
+static int v4l2_frame_callback(struct v4l2_capture* ctx, const struct v4l2_capture_frame* frame, void* user);
 
 /*===========================================================================*\
  * local object definitions
 \*===========================================================================*/
-static struct v4l2_format selected_format;
-static struct v4l2_buffer_descriptor* buffer_descriptors;
 
 /*===========================================================================*\
  * inline function definitions
@@ -95,21 +92,71 @@ static struct v4l2_buffer_descriptor* buffer_descriptors;
 \*===========================================================================*/
 int main(int argc, char *argv[])
 {
-    int fd;
-    uint32_t capabilities;
-    int number_of_frames = 1;
-    int number_of_buffers = 1;
-    bool use_compressed_formats = false;
+    struct v4l2_capture* ctx;
+    int number_of_frames = 0;
+    const char* record_filename = NULL;
+    bool replay = false;
+    struct v4l2_capture_replay_config replay_config = {
+        .filenames = NULL,
+        .number_of_files = 0,
+        .width = 0,
+        .height = 0,
+        .loops = 1,
+        .paced = false,
+    };
+    struct v4l2_capture_config config = {
+        .number_of_buffers = 1,
+        .use_compressed_formats = false,
+        .verbose = true,
+        .rt = {
+            .enabled = false,
+            .policy = V4L2_CAPTURE_RT_POLICY_NONE,
+            .priority = V4L2_CAPTURE_RT_DEFAULT_PRIORITY,
+            .cpu = -1,
+        },
+    };
+    struct v4l2_capture_control_profile controls;
+    struct v4l2_capture_state state = {
+        .counter = 0,
+        .timestamps = NULL,
+        .max_timestamps = 0,
+        .record_fd = -1,
+        .bytes = 0,
+        .first_dequeue_time_ns = 0,
+        .last_done_time_ns = 0,
+        .latency_sum_ns = 0,
+        .latency_max_ns = 0,
+        .pyramid = NULL,
+        .pyramid_levels = 0,
+        .store_frames = true,
+        .prefix = "image",
+    };
 
     static struct option long_options[] = {
         {"number-of-frames",       required_argument, 0, 'n'},
         {"number-of-buffers",      required_argument, 0, 'b'},
         {"use-compressed-formats", no_argument,       0, 'c'},
+        {"realtime",               no_argument,       0, 'r'},
+        {"rt-policy",              required_argument, 0, 's'},
+        {"rt-priority",            required_argument, 0, 'p'},
+        {"cpu",                    required_argument, 0, 'a'},
+        {"frame-rate",             required_argument, 0, 'f'},
+        {"controls",               required_argument, 0, 'e'},
+        {"lock-fps",               no_argument,       0, 'l'},
+        {"pyramid",                required_argument, 0, 'z'},
+        {"pyramid-only",           no_argument,       0, 'Z'},
+        {"record",                 required_argument, 0, 'o'},
+        {"replay",                 no_argument,       0, 'i'},
+        {"replay-loops",           required_argument, 0, 'x'},
+        {"replay-timed",           no_argument,       0, 't'},
+        {"replay-size",            required_argument, 0, 'g'},
         {0, 0, 0, 0}
     };
 
+    v4l2_capture_control_profile_init(&controls);
+
     for (;;) {
-        int c = getopt_long(argc, argv, "n:b:c", long_options, 0);
+        int c = getopt_long(argc, argv, "n:b:crs:p:a:f:e:lz:Zo:ix:tg:", long_options, 0);
         if (-1 == c)
             break;
 
@@ -119,11 +166,91 @@ int main(int argc, char *argv[])
                 break;
 
             case 'b':
-                number_of_buffers = atoi(optarg);
+                config.number_of_buffers = atoi(optarg);
                 break;
 
             case 'c':
-                use_compressed_formats = true;
+                config.use_compressed_formats = true;
+                break;
+
+            case 'r':
+                config.rt.enabled = true;
+                break;
+
+            case 's':
+                if (0 == strcmp(optarg, "fifo"))
+                    config.rt.policy = V4L2_CAPTURE_RT_POLICY_FIFO;
+                else
+                if (0 == strcmp(optarg, "deadline"))
+                    config.rt.policy = V4L2_CAPTURE_RT_POLICY_DEADLINE;
+                else {
+                    fprintf(stderr, "unknown scheduling policy '%s'\n", optarg);
+                    v4l2_print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                config.rt.enabled = true;
+                break;
+
+            case 'p':
+                config.rt.priority = atoi(optarg);
+                config.rt.enabled = true;
+                break;
+
+            case 'a':
+                config.rt.cpu = atoi(optarg);
+                config.rt.enabled = true;
+                break;
+
+            case 'f':
+                config.frame_rate = atoi(optarg) > 0 ? atoi(optarg) : 0;
+                break;
+
+            case 'e':
+                if (v4l2_capture_control_profile_parse(&controls, optarg)) {
+                    v4l2_print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                config.controls = &controls;
+                break;
+
+            case 'l':
+                controls.lock_fps = true;
+                config.controls = &controls;
+                break;
+
+            case 'z':
+                if (v4l2_parse_pyramid_levels(optarg, &state.pyramid_levels)) {
+                    v4l2_print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'Z':
+                state.store_frames = false;
+                break;
+
+            case 'o':
+                record_filename = optarg;
+                break;
+
+            case 'i':
+                replay = true;
+                break;
+
+            case 'x':
+                replay_config.loops = atoi(optarg);
+                break;
+
+            case 't':
+                replay_config.paced = true;
+                break;
+
+            case 'g':
+                if (2 != sscanf(optarg, "%ux%u", &replay_config.width, &replay_config.height)) {
+                    fprintf(stderr, "invalid frame size '%s'\n", optarg);
+                    v4l2_print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
                 break;
 
             default:
@@ -132,64 +259,123 @@ int main(int argc, char *argv[])
         }
     }
 
+    /* by default a camera delivers a single frame and a replay source all of its frames */
     if (number_of_frames < 1)
-        number_of_frames = 1;
+        number_of_frames = replay ? 0 : 1;
 
-    if (number_of_buffers < 1)
-        number_of_buffers = 1;
+    if (config.number_of_buffers < 1)
+        config.number_of_buffers = 1;
 
-    const char* filename = argv[optind];
-    if (!filename) {
-        fprintf(stderr, "device filename is not provided\n");
+    if (config.rt.enabled && config.rt.policy == V4L2_CAPTURE_RT_POLICY_NONE)
+        config.rt.policy = V4L2_CAPTURE_RT_POLICY_FIFO;
+
+    if (config.rt.cpu >= 0 && config.rt.policy == V4L2_CAPTURE_RT_POLICY_DEADLINE) {
+        fprintf(stderr, "-a cannot be combined with -s deadline, "
+            "use an exclusive cpuset to restrict SCHED_DEADLINE to given cpus\n");
         v4l2_print_usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    fd = open(filename, O_RDWR);
-    if (-1 == fd) {
-        fprintf(stderr, "cannot open '%s': %s\n", filename, strerror(errno));
+    if (!state.store_frames && state.pyramid_levels == 0) {
+        fprintf(stderr, "--pyramid-only requires --pyramid levels\n");
         v4l2_print_usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    memset(&selected_format, 0, sizeof(selected_format));
+    const char* filename = argv[optind];
+    if (!filename) {
+        fprintf(stderr, "%s is not provided\n", replay ? "replay filename" : "device filename");
+        v4l2_print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
 
-    capabilities = v4l2_query_capabilities(fd, use_compressed_formats ? V4L2_FMT_FLAG_COMPRESSED : 0);
-    if (!(capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
-        !(capabilities & V4L2_CAP_STREAMING)) {
-        fprintf(stderr, "%s do not support video capture or streaming\n", filename);
+    if (replay) {
+        state.prefix = "replay";
+        replay_config.filenames = (const char* const*)(argv + optind);
+        replay_config.number_of_files = argc - optind;
+        ctx = v4l2_capture_open_replay(&replay_config);
+    } else
+        ctx = v4l2_capture_open(filename);
+    if (NULL == ctx) {
+        v4l2_print_usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    if (selected_format.type == 0) {
-        fprintf(stderr, "No frame format is selected for capturing\n");
+    if (v4l2_capture_configure(ctx, &config)) {
+        fprintf(stderr, "v4l2_capture_configure() failed\n");
         exit(EXIT_FAILURE);
     }
 
-    v4l2_print_format(&selected_format);
+    if (state.pyramid_levels) {
+        const struct v4l2_format* format = v4l2_capture_get_format(ctx);
+        int number_of_levels = 32 - __builtin_clz(state.pyramid_levels);
 
-    if (-1 == ioctl(fd, VIDIOC_S_FMT, &selected_format)) {
-        fprintf(stderr, "VIDIOC_S_FMT failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        state.pyramid = v4l2_pyramid_create(format->fmt.pix.pixelformat,
+            format->fmt.pix.width, format->fmt.pix.height, format->fmt.pix.bytesperline,
+            number_of_levels);
+        if (NULL == state.pyramid) {
+            fprintf(stderr, "v4l2_pyramid_create() failed\n");
+            exit(EXIT_FAILURE);
+        }
     }
 
-    number_of_buffers = v4l2_query_buffers(fd, number_of_buffers);
-    if (number_of_buffers < 0) {
-        fprintf(stderr, "v4l2_query_buffers() failed\n");
-        exit(EXIT_FAILURE);
+    if (record_filename) {
+        state.record_fd = open(record_filename, O_WRONLY | O_CREAT | O_APPEND, 0664);
+        if (-1 == state.record_fd) {
+            fprintf(stderr, "cannot open '%s': %s\n", record_filename, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        if (v4l2_capture_is_replay_source(ctx, state.record_fd)) {
+            fprintf(stderr, "cannot record to '%s', it is being replayed\n", record_filename);
+            exit(EXIT_FAILURE);
+        }
     }
 
-    if (v4l2_queue_buffers(fd, number_of_buffers)) {
-        fprintf(stderr, "v4l2_queue_buffers() failed\n");
-        exit(EXIT_FAILURE);
+    if (config.rt.enabled) {
+        state.max_timestamps = number_of_frames;
+        if (state.max_timestamps == 0 && replay_config.loops > 0)
+            state.max_timestamps = v4l2_capture_get_number_of_buffers(ctx) * replay_config.loops;
+        if (state.max_timestamps == 0) {
+            fprintf(stderr, "endless replay, dequeue interval statistics are not collected\n");
+        } else {
+            /* allocated after mlockall(MCL_FUTURE), so the capture loop never faults on it */
+            state.timestamps = calloc(state.max_timestamps, sizeof(*state.timestamps));
+            if (NULL == state.timestamps) {
+                fprintf(stderr, "calloc(%d, %zu) failed\n", state.max_timestamps, sizeof(*state.timestamps));
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 
-    if (v4l2_video_capture(fd, number_of_frames)) {
-        fprintf(stderr, "v4l2_capture_image() failed\n");
+    if (v4l2_capture_run(ctx, number_of_frames, v4l2_frame_callback, &state)) {
+        fprintf(stderr, "v4l2_capture_run() failed\n");
         exit(EXIT_FAILURE);
     }
 
-    close(fd);
+    if (state.record_fd != -1)
+        close(state.record_fd);
+
+    v4l2_print_processing_statistics(&state);
+
+    if (state.timestamps) {
+        v4l2_print_jitter(state.timestamps,
+            state.counter < state.max_timestamps ? state.counter : state.max_timestamps,
+            v4l2_capture_get_frame_interval(ctx));
+        free(state.timestamps);
+    }
+
+    if (v4l2_capture_get_measured_frame_interval(ctx) > 0)
+        fprintf(stdout,
+            "frame interval:\n"
+            "\ttarget      : %" PRIu64 " us\n"
+            "\tmeasured    : %" PRIu64 " us\n",
+            v4l2_capture_get_frame_interval(ctx) / 1000,
+            v4l2_capture_get_measured_frame_interval(ctx) / 1000
+            );
+
+    v4l2_pyramid_destroy(state.pyramid);
+    v4l2_capture_close(ctx);
     return 0;
 }
 
@@ -198,523 +384,133 @@ int main(int argc, char *argv[])
 \*===========================================================================*/
 static void v4l2_print_usage(const char* progname)
 {
-    fprintf(stdout, "usage: %s [-n <frames>] [-b <buffers>] [-c] <filename>\n", progname);
+    fprintf(stdout, "usage: %s [-n <frames>] [-b <buffers>] [-c] [-r] [-s <policy>] [-p <priority>] [-a <cpu>] [-f <fps>] [-e <controls>] [-l] [-z <scales>] [-Z] [-o <stream>] <filename>\n", progname);
+    fprintf(stdout, "       %s -i [-x <loops>] [-t] [-g <width>x<height>] [options] <file>...\n", progname);
     fprintf(stdout, " options:\n");
     fprintf(stdout, "  -n <frames>  --number-of-frames=<frames>   : number of frames to be captured (default: 1)\n");
     fprintf(stdout, "  -b <buffers> --number-of-buffers=<buffers> : number of buffers to be allocated for capturing (default: 1)\n");
     fprintf(stdout, "  -c --use-compressed-formats                : if set, capturing will search for compressed formats\n");
+    fprintf(stdout, "  -r --realtime                              : lock and prefault memory, use real-time scheduling and report dequeue jitter\n");
+    fprintf(stdout, "  -s <policy>  --rt-policy=<policy>          : real-time scheduling policy: fifo or deadline (default: fifo, implies -r)\n");
+    fprintf(stdout, "                                               deadline cannot be combined with -a, use a cpuset instead\n");
+    fprintf(stdout, "  -p <prio>    --rt-priority=<prio>          : SCHED_FIFO priority (default: %d, implies -r)\n", V4L2_CAPTURE_RT_DEFAULT_PRIORITY);
+    fprintf(stdout, "  -a <cpu>     --cpu=<cpu>                   : pin capturing to the given cpu (implies -r, not with -s deadline)\n");
+    fprintf(stdout, "  -f <fps>     --frame-rate=<fps>            : frame rate requested with VIDIOC_S_PARM (default: driver default)\n");
+    fprintf(stdout, "  -e <controls> --controls=<controls>        : controls profile applied before streaming, comma separated list of\n");
+    fprintf(stdout, "                                               exposure=auto|manual|shutter|aperture, exposure-time=<100us units>,\n");
+    fprintf(stdout, "                                               auto-priority=0|1, gain=<gain>, power-line=disabled|50|60|auto, lock-fps\n");
+    fprintf(stdout, "  -l --lock-fps                              : do not let exposure stretch the frame interval (same as -e lock-fps)\n");
+    fprintf(stdout, "  -z <scales>  --pyramid=<scales>            : also store downscaled frames (YUYV, NV12 and GREY only), comma separated\n");
+    fprintf(stdout, "                                               list of 2, 4, 8, ... written as imageNNNN_<scale>.<fourcc>\n");
+    fprintf(stdout, "  -Z --pyramid-only                          : store downscaled frames instead of full frames\n");
+    fprintf(stdout, "  -o <stream>  --record=<stream>             : also append every frame (with its timestamp) to a stream file\n");
+    fprintf(stdout, "  -i --replay                                : read frames from imageNNNN.<fourcc> files and/or recorded streams\n");
+    fprintf(stdout, "                                               instead of a capturing device, frames are stored as replayNNNN.<fourcc>\n");
+    fprintf(stdout, "                                               (default number of frames: all)\n");
+    fprintf(stdout, "  -x <loops>   --replay-loops=<loops>        : number of passes over the replayed frames, 0 for endless (default: 1)\n");
+    fprintf(stdout, "  -t --replay-timed                          : replay at original timestamps (file modification times for images)\n");
+    fprintf(stdout, "  -g <w>x<h>   --replay-size=<w>x<h>         : frame size of replayed image files, which do not carry it\n");
     fprintf(stdout, "  <filename>                                 : capturing device (e.g. /dev/video0)\n");
+    fprintf(stdout, "  <file>...                                  : files to be replayed (with -i)\n");
 }
 
-static const char* v4l2_capabilities_to_string(char* buf, size_t size, uint32_t capabilities)
-{
-    size_t i;
-    int n;
-    char *p = buf;
-
-    static const char* caps[] = {
-        "V4L2_CAP_VIDEO_CAPTURE",
-        "V4L2_CAP_VIDEO_OUTPUT",
-        "V4L2_CAP_VIDEO_OVERLAY",
-        "UNKNOWN_0x00000008",
-        "V4L2_CAP_VBI_CAPTURE",
-        "V4L2_CAP_VBI_OUTPUT",
-        "V4L2_CAP_SLICED_VBI_CAPTURE",
-        "V4L2_CAP_SLICED_VBI_OUTPUT",
-        "V4L2_CAP_RDS_CAPTURE",
-        "V4L2_CAP_VIDEO_OUTPUT_OVERLAY",
-        "V4L2_CAP_HW_FREQ_SEEK",
-        "V4L2_CAP_RDS_OUTPUT",
-        "V4L2_CAP_VIDEO_CAPTURE_MPLANE",
-        "V4L2_CAP_VIDEO_OUTPUT_MPLANE",
-        "V4L2_CAP_VIDEO_M2M_MPLANE",
-        "V4L2_CAP_VIDEO_M2M",
-        "V4L2_CAP_TUNER",
-        "V4L2_CAP_AUDIO",
-        "V4L2_CAP_RADIO",
-        "V4L2_CAP_MODULATOR",
-        "V4L2_CAP_SDR_CAPTURE",
-        "V4L2_CAP_EXT_PIX_FORMAT",
-        "V4L2_CAP_SDR_OUTPUT",
-        "V4L2_CAP_META_CAPTURE",
-        "V4L2_CAP_READWRITE",
-        "V4L2_CAP_ASYNCIO",
-        "V4L2_CAP_STREAMING",
-        "V4L2_CAP_META_OUTPUT",
-        "V4L2_CAP_TOUCH",
-        "UNKNOWN_0x20000000",
-        "UNKNOWN_0x40000000",
-        "V4L2_CAP_DEVICE_CAPS",
-    };
-
-    memset(p, 0, size);
-
-    for (i = 0; i < (sizeof(caps) / sizeof(caps[0])); ++i)
-        if (capabilities & (1U << i)) {
-            n = snprintf(p, size, "\t\t%s\n", caps[i]);
-            if (n < 0)
-                return NULL;
-            if ((size_t)n >= size)
-                break;
-            p += n;
-            size -= n;
-        }
-
-    return buf;
-}
-
-static const char* v4l2_buf_type_to_string(enum v4l2_buf_type buf_type)
-{
-    static const char* buf_types[] = {
-        [0]                                  = "0",
-        [V4L2_BUF_TYPE_VIDEO_CAPTURE]        = "V4L2_BUF_TYPE_VIDEO_CAPTURE",
-        [V4L2_BUF_TYPE_VIDEO_OVERLAY]        = "V4L2_BUF_TYPE_VIDEO_OVERLAY",
-        [V4L2_BUF_TYPE_VIDEO_OUTPUT]         = "V4L2_BUF_TYPE_VIDEO_OUTPUT",
-        [V4L2_BUF_TYPE_VBI_CAPTURE]          = "V4L2_BUF_TYPE_VBI_CAPTURE",
-        [V4L2_BUF_TYPE_VBI_OUTPUT]           = "V4L2_BUF_TYPE_VBI_OUTPUT",
-        [V4L2_BUF_TYPE_SLICED_VBI_CAPTURE]   = "V4L2_BUF_TYPE_SLICED_VBI_CAPTURE",
-        [V4L2_BUF_TYPE_SLICED_VBI_OUTPUT]    = "V4L2_BUF_TYPE_SLICED_VBI_OUTPUT",
-        [V4L2_BUF_TYPE_VIDEO_OUTPUT_OVERLAY] = "V4L2_BUF_TYPE_VIDEO_OUTPUT_OVERLAY",
-        [V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE] = "V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE",
-        [V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE]  = "V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE",
-        [V4L2_BUF_TYPE_SDR_CAPTURE]          = "V4L2_BUF_TYPE_SDR_CAPTURE",
-        [V4L2_BUF_TYPE_SDR_OUTPUT]           = "V4L2_BUF_TYPE_SDR_OUTPUT",
-    };
-
-    if (buf_type > (sizeof(buf_types) / sizeof(buf_types[0])))
-        buf_type = 0;
-
-    return buf_types[buf_type];
-}
-
-static const char* v4l2_frmsizetype_to_string(enum v4l2_frmsizetypes type)
-{
-    static const char* types[] = {
-        [0]                              = "0",
-        [V4L2_FRMSIZE_TYPE_DISCRETE]     = "V4L2_FRMSIZE_TYPE_DISCRETE",
-        [V4L2_FRMSIZE_TYPE_CONTINUOUS]   = "V4L2_FRMSIZE_TYPE_CONTINUOUS",
-        [V4L2_FRMSIZE_TYPE_STEPWISE]     = "V4L2_FRMSIZE_TYPE_STEPWISE",
-    };
-
-    if (type >= (sizeof(types) / sizeof(types[0])))
-        type = 0;
-
-    return types[type];
-}
-
-static const char* v4l2_frmivaltype_to_string(enum v4l2_frmivaltypes type)
-{
-    static const char* types[] = {
-        [0]                              = "0",
-        [V4L2_FRMIVAL_TYPE_DISCRETE]     = "V4L2_FRMIVAL_TYPE_DISCRETE",
-        [V4L2_FRMIVAL_TYPE_CONTINUOUS]   = "V4L2_FRMIVAL_TYPE_CONTINUOUS",
-        [V4L2_FRMIVAL_TYPE_STEPWISE]     = "V4L2_FRMIVAL_TYPE_STEPWISE",
-    };
-
-    if (type >= (sizeof(types) / sizeof(types[0])))
-        type = 0;
-
-    return types[type];
-}
-
-static void v4l2_print_capabilities(const struct v4l2_capability* caps)
+static int v4l2_compare_u64(const void* a, const void* b)
 {
-    char buf1[1024];
-    char buf2[1024];
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
 
-    fprintf(stdout,
-        "VIDIOC_QUERYCAP:\n"
-        "\tdriver       : %s\n"
-        "\tcard         : %s\n"
-        "\tbus_info     : %s\n"
-        "\tversion      : 0x%08x\n"
-        "\tcapabilities : 0x%08x\n"
-        "%s"
-        "\tdevice_caps  : 0x%08x\n"
-        "%s",
-        caps->driver,
-        caps->card,
-        caps->bus_info,
-        caps->version,
-        caps->capabilities,
-        v4l2_capabilities_to_string(buf1, sizeof(buf1), caps->capabilities),
-        caps->device_caps,
-        v4l2_capabilities_to_string(buf2, sizeof(buf2), caps->device_caps)
-        );
-}
-
-static void v4l2_print_fmtdesc(const struct v4l2_fmtdesc* fmtdesc)
-{
-    fprintf(stdout,
-        "VIDIOC_ENUM_FMT:\n"
-        "\tindex       : %u\n"
-        "\ttype        : %s\n"
-        "\tflags       : 0x%08x\n"
-        "\tdescription : %s\n"
-        "\tpixelformat : '%c%c%c%c'\n",
-        fmtdesc->index,
-        v4l2_buf_type_to_string(fmtdesc->type),
-        fmtdesc->flags,
-        fmtdesc->description,
-        (fmtdesc->pixelformat >>  0) & 0xff,
-        (fmtdesc->pixelformat >>  8) & 0xff,
-        (fmtdesc->pixelformat >> 16) & 0xff,
-        (fmtdesc->pixelformat >> 24) & 0xff
-        );
+    return (x > y) - (x < y);
 }
 
-static void v4l2_print_frmsizeenum(const struct v4l2_frmsizeenum* frmsizeenum)
+static void v4l2_print_jitter(const uint64_t* timestamps, int count, uint64_t frame_interval_ns)
 {
-    fprintf(stdout,
-        "\tVIDIOC_ENUM_FRAMESIZES:\n"
-        "\t\tindex       : %u\n"
-        "\t\tpixelformat : '%c%c%c%c'\n"
-        "\t\ttype        : %s\n",
-        frmsizeenum->index,
-        (frmsizeenum->pixel_format >>  0) & 0xff,
-        (frmsizeenum->pixel_format >>  8) & 0xff,
-        (frmsizeenum->pixel_format >> 16) & 0xff,
-        (frmsizeenum->pixel_format >> 24) & 0xff,
-        v4l2_frmsizetype_to_string(frmsizeenum->type)
-        );
-
-    if (frmsizeenum->type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-        fprintf(stdout,
-            "\t\tdiscrete    : width: %u, height: %u\n",
-            frmsizeenum->discrete.width,
-            frmsizeenum->discrete.height
-            );
-    } else
-    if (frmsizeenum->type == V4L2_FRMSIZE_TYPE_STEPWISE) {
+    uint64_t* intervals;
+    uint64_t* deviations;
+    int n = 0;
+    int i;
 
-    } else {
-        /* do nothing */
+    intervals = calloc(2 * (size_t)count, sizeof(*intervals));
+    if (NULL == intervals) {
+        fprintf(stderr, "calloc(%d, %zu) failed\n", 2 * count, sizeof(*intervals));
+        return;
+    }
+    deviations = intervals + count;
+
+    /* only delivered frames are timestamped, so an interval spanning a failed
+       dequeue (e.g. a select() timeout) is measured as it was seen by the consumer */
+    for (i = 1; i < count; ++i) {
+        intervals[n] = timestamps[i] - timestamps[i - 1];
+        deviations[n] = intervals[n] > frame_interval_ns ?
+            intervals[n] - frame_interval_ns : frame_interval_ns - intervals[n];
+        n++;
     }
-}
-
-static void v4l2_print_frmivalenum(const struct v4l2_frmivalenum* frmivalenum)
-{
-    fprintf(stdout,
-        "\t\tVIDIOC_ENUM_FRAMEINTERVALS:\n"
-        "\t\t\tindex       : %u\n"
-        "\t\t\tpixelformat : '%c%c%c%c'\n"
-        "\t\t\twidth       : %u\n"
-        "\t\t\theight      : %u\n"
-        "\t\t\ttype        : %s\n",
-        frmivalenum->index,
-        (frmivalenum->pixel_format >>  0) & 0xff,
-        (frmivalenum->pixel_format >>  8) & 0xff,
-        (frmivalenum->pixel_format >> 16) & 0xff,
-        (frmivalenum->pixel_format >> 24) & 0xff,
-        frmivalenum->width,
-        frmivalenum->height,
-        v4l2_frmivaltype_to_string(frmivalenum->type)
-        );
-
-        if (frmivalenum->type == V4L2_FRMIVAL_TYPE_DISCRETE) {
-            fprintf(stdout,
-                "\t\t\tdiscrete    : %u/%u\n",
-                frmivalenum->discrete.numerator,
-                frmivalenum->discrete.denominator
-                );
-        } else
-        if (frmivalenum->type == V4L2_FRMSIZE_TYPE_STEPWISE) {
-            fprintf(stdout,
-                "\t\t\tstepwise    : min: %u/%u, max: %u/%u, step: %u/%u\n",
-                frmivalenum->stepwise.min.numerator,
-                frmivalenum->stepwise.min.denominator,
-                frmivalenum->stepwise.max.numerator,
-                frmivalenum->stepwise.max.denominator,
-                frmivalenum->stepwise.step.numerator,
-                frmivalenum->stepwise.step.denominator
-                );
-        } else {
-            /* do nothing */
-        }
-}
-
-static void v4l2_print_cropping_capabilities(const struct v4l2_cropcap* cropcap)
-{
-    fprintf(stdout,
-        "VIDIOC_CROPCAP:\n"
-        "\tbounds      : left: %d, top: %d, width: %u, height: %u\n"
-        "\tdefrect     : left: %d, top: %d, width: %u, height: %u\n"
-        "\tpixelaspect : numerator: %u, denominator: %u\n",
-        cropcap->bounds.left, cropcap->bounds.top, cropcap->bounds.width, cropcap->bounds.height,
-        cropcap->defrect.left, cropcap->defrect.top, cropcap->defrect.width, cropcap->defrect.height,
-        cropcap->pixelaspect.numerator, cropcap->pixelaspect.denominator
-        );
-}
-
-static void v4l2_print_format(const struct v4l2_format* format)
-{
-    fprintf(stdout,
-        "selected frame format:\n"
-        "\ttype        : %s\n"
-        "\tdiscrete    : width: %u, height: %u\n"
-        "\tpixelformat : '%c%c%c%c'\n",
-        v4l2_buf_type_to_string(format->type),
-        format->fmt.pix.width,
-        format->fmt.pix.height,
-        (format->fmt.pix.pixelformat >>  0) & 0xff,
-        (format->fmt.pix.pixelformat >>  8) & 0xff,
-        (format->fmt.pix.pixelformat >> 16) & 0xff,
-        (format->fmt.pix.pixelformat >> 24) & 0xff
-        );
-}
-
-static uint32_t v4l2_query_capabilities(int fd, uint32_t flags)
-{
-    uint32_t capabilities = 0;
-
-    do {
-        int status;
-        struct v4l2_capability caps;
-        struct v4l2_fmtdesc fmtdesc;
-        struct v4l2_cropcap cropcap;
-        struct v4l2_frmsizeenum frmsizeenum;
-        struct v4l2_frmivalenum frmivalenum;
-
-        memset(&caps, 0, sizeof(caps));
-        status = ioctl(fd, VIDIOC_QUERYCAP, &caps);
-        if (-1 == status) {
-            fprintf(stderr, "VIDIOC_QUERYCAP failed: %s\n", strerror(errno));
-            break;
-        }
-
-        capabilities = caps.capabilities;
-        v4l2_print_capabilities(&caps);
-
-        memset(&fmtdesc, 0, sizeof(fmtdesc));
-        fmtdesc.index = 0;
-        fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        for (; 0 == (status = ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc)); fmtdesc.index++) {
-            v4l2_print_fmtdesc(&fmtdesc);
-
-            memset(&frmsizeenum, 0, sizeof(frmsizeenum));
-            frmsizeenum.index = 0;
-            frmsizeenum.pixel_format = fmtdesc.pixelformat;
-            for (; 0 == (status = ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmsizeenum)); frmsizeenum.index++) {
-                if (V4L2_FRMSIZE_TYPE_DISCRETE == frmsizeenum.type) {
-                    v4l2_print_frmsizeenum(&frmsizeenum);
-
-                    if (selected_format.type == 0) {
-                        if ((flags ^ fmtdesc.flags) == 0) {
-                            selected_format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                            selected_format.fmt.pix.width = frmsizeenum.discrete.width;
-                            selected_format.fmt.pix.height = frmsizeenum.discrete.height;
-                            selected_format.fmt.pix.pixelformat = frmsizeenum.pixel_format;
-                        }
-                    }
-
-                    memset(&frmivalenum, 0, sizeof(frmivalenum));
-                    frmivalenum.index = 0;
-                    frmivalenum.pixel_format = frmsizeenum.pixel_format;
-                    frmivalenum.width = frmsizeenum.discrete.width;
-                    frmivalenum.height = frmsizeenum.discrete.height;
-                    for (; 0 == (status = ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmivalenum)); frmivalenum.index++)
-                        v4l2_print_frmivalenum(&frmivalenum);
-                    if (-1 == status && errno != EINVAL)
-                        fprintf(stderr, "VIDIOC_ENUM_FRAMEINTERVALS failed: %s\n", strerror(errno));
-                }
-            }
-            if (-1 == status && errno != EINVAL)
-                fprintf(stderr, "VIDIOC_ENUM_FRAMESIZES failed: %s\n", strerror(errno));
-        }
-        if (-1 == status && errno != EINVAL)
-            fprintf(stderr, "VIDIOC_ENUM_FMT failed: %s\n", strerror(errno));
-
-        memset(&cropcap, 0, sizeof(cropcap));
-        cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        status = ioctl(fd, VIDIOC_CROPCAP, &cropcap);
-        if (-1 == status) {
-            fprintf(stderr, "VIDIOC_CROPCAP failed: %s\n", strerror(errno));
-            break;
-        }
-
-        v4l2_print_cropping_capabilities(&cropcap);
-    } while (0);
-
-    return capabilities;
-}
-
-static int v4l2_query_buffers(int fd, int number_of_buffers)
-{
-    int retval = -1;
-
-    do {
-        struct v4l2_requestbuffers requestbuffers;
-        uint32_t i;
-
-        memset(&requestbuffers, 0, sizeof(requestbuffers));
-        requestbuffers.count = number_of_buffers;
-        requestbuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        requestbuffers.memory = V4L2_MEMORY_MMAP;
 
-        if (-1 == ioctl(fd, VIDIOC_REQBUFS, &requestbuffers)) {
-            fprintf(stderr, "VIDIOC_REQBUFS failed: %s\n", strerror(errno));
-            break;
-        }
+    if (n > 0) {
+        qsort(intervals, n, sizeof(*intervals), v4l2_compare_u64);
+        qsort(deviations, n, sizeof(*deviations), v4l2_compare_u64);
 
         fprintf(stdout,
-            "VIDIOC_REQBUFS:\n"
-            "\trequested count: %u, commited count: %u\n",
-            number_of_buffers, requestbuffers.count
+            "dequeue interval statistics (%d intervals, nominal: %" PRIu64 " us):\n"
+            "\tinterval    : p50: %" PRIu64 " us, p99: %" PRIu64 " us, max: %" PRIu64 " us\n"
+            "\tjitter      : p50: %" PRIu64 " us, p99: %" PRIu64 " us, max: %" PRIu64 " us\n",
+            n, frame_interval_ns / 1000,
+            intervals[n / 2] / 1000, intervals[(n * 99) / 100] / 1000, intervals[n - 1] / 1000,
+            deviations[n / 2] / 1000, deviations[(n * 99) / 100] / 1000, deviations[n - 1] / 1000
             );
+    } else
+        fprintf(stdout, "dequeue interval statistics: not enough frames\n");
 
-        buffer_descriptors = calloc(requestbuffers.count, sizeof(*buffer_descriptors));
-        if (NULL == buffer_descriptors) {
-            fprintf(stderr, "calloc(%u, %zu) failed\n",
-                requestbuffers.count, sizeof(*buffer_descriptors));
-            break;
-        }
-
-        for (i = 0; i < requestbuffers.count; ++i) {
-            struct v4l2_buffer buffer;
-            struct v4l2_buffer_descriptor* bd;
-            void* addr;
-
-            memset(&buffer, 0, sizeof(buffer));
-            buffer.index = i;
-            buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buffer.memory = V4L2_MEMORY_MMAP;
-            if(-1 == ioctl(fd, VIDIOC_QUERYBUF, &buffer)) {
-                fprintf(stderr, "VIDIOC_QUERYBUF[%d] failed: %s\n", i, strerror(errno));
-                break;
-            }
-
-            fprintf(stdout,
-                "VIDIOC_QUERYBUF[%u]:\n"
-                "\tlength: %u, offset: %u\n",
-                i, buffer.length, buffer.m.offset
-                );
-
-            addr = mmap(
-                NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
-            if (MAP_FAILED == addr) {
-                fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
-                break;
-            }
-
-            bd = buffer_descriptors + i;
-            bd->index = i;
-            bd->addr = addr;
-            bd->size = buffer.length;
-            bd->offset = buffer.m.offset;
-        }
-
-        if (i < requestbuffers.count)
-            break;
-
-        retval = requestbuffers.count;
-    } while (0);
-
-    return retval;
-}
-
-static int v4l2_queue_buffers(int fd, int number_of_buffers)
-{
-    int retval = -1;
-
-    do {
-        int i;
-
-        for (i = 0; i < number_of_buffers; ++i) {
-            struct v4l2_buffer buffer;
-
-            memset(&buffer, 0, sizeof(buffer));
-            buffer.index = i;
-            buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buffer.memory = V4L2_MEMORY_MMAP;
-            if(-1 == ioctl(fd, VIDIOC_QBUF, &buffer)) {
-                fprintf(stderr, "VIDIOC_QBUF[%d] failed: %s\n", i, strerror(errno));
-                break;
-            }
-        }
-
-        if (i < number_of_buffers)
-            break;
-
-        retval = 0;
-    } while (0);
-
-    return retval;
+    free(intervals);
 }
 
-static int v4l2_capture_frame(int fd, void** frame_buffer, size_t* frame_size)
+static int v4l2_parse_pyramid_levels(const char* str, uint32_t* levels)
 {
-    int retval = -1;
-
-    do {
-        int status;
-        struct v4l2_buffer buffer;
-        fd_set fds;
-        struct timespec ts;
-        uint32_t index;
-
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-
-        ts.tv_sec = V4l2_SELECT_TIMEOUT_SEC;
-        ts.tv_nsec = 0;
-        status = pselect(fd+1, &fds, NULL, NULL, &ts, NULL);
-        if (-1 == status) {
-            fprintf(stderr, "pselect() failed: %s\n", strerror(errno));
-            break;
-        } else
-        if (0 == status) {
-            fprintf(stderr, "no data within %d seconds, timeout expired\n", V4l2_SELECT_TIMEOUT_SEC);
-            break;
-        }
-
-        memset(&buffer, 0, sizeof(buffer));
-        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer.memory = V4L2_MEMORY_MMAP;
-
-        if(-1 == ioctl(fd, VIDIOC_DQBUF, &buffer)) {
-            fprintf(stderr, "VIDIOC_DQBUF failed: %s\n", strerror(errno));
-            break;
+    const char* p = str;
+
+    while (*p) {
+        char* end;
+        long scale = strtol(p, &end, 10);
+        int level;
+
+        /* only powers of two starting from 2 are valid scales */
+        if (end == p || scale < 2 || (scale & (scale - 1)) ||
+            (level = __builtin_ctzl(scale) - 1) >= V4L2_PYRAMID_MAX_LEVELS) {
+            fprintf(stderr, "invalid pyramid scale in '%s'\n", str);
+            return -1;
         }
 
-        fprintf(stdout,
-            "VIDIOC_DQBUF[%u]:\n"
-            "\tbytesused: %u\n",
-            buffer.index, buffer.bytesused
-            );
-
-        index = buffer.index;
-
-        if (frame_buffer)
-            *frame_buffer = buffer_descriptors[index].addr;
-        if (frame_size)
-            *frame_size = buffer.bytesused;
+        *levels |= 1U << level;
 
-        memset(&buffer, 0, sizeof(buffer));
-        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer.memory = V4L2_MEMORY_MMAP;
-        buffer.index = index;
-
-        if(-1 == ioctl(fd, VIDIOC_QBUF, &buffer)) {
-            fprintf(stderr, "VIDIOC_QBUF failed: %s\n", strerror(errno));
-            break;
+        p = end;
+        if (*p == ',')
+            p++;
+        else
+        if (*p != '\0') {
+            fprintf(stderr, "invalid pyramid scale in '%s'\n", str);
+            return -1;
         }
+    }
 
-        retval = 0;
-    } while (0);
-
-    return retval;
+    return 0;
 }
 
-static void v4l2_store_frame(const uint8_t* image, uint32_t fourcc, size_t size, int counter)
+static void v4l2_store_frame(const struct v4l2_capture* ctx, const char* prefix,
+    const uint8_t* image, uint32_t fourcc, size_t size, int counter, uint32_t scale)
 {
     char image_filename[256];
+    char scale_suffix[16] = "";
     int fd = -1;
 
     do {
         int n;
 
-        n = snprintf(image_filename, sizeof(image_filename), "image%04d.%c%c%c%c",
+        if (scale > 1)
+            snprintf(scale_suffix, sizeof(scale_suffix), "_%u", scale);
+
+        n = snprintf(image_filename, sizeof(image_filename), "%s%04d%s.%c%c%c%c",
+            prefix,
             counter,
+            scale_suffix,
             (fourcc >>  0) & 0xff,
             (fourcc >>  8) & 0xff,
             (fourcc >> 16) & 0xff,
@@ -726,12 +522,23 @@ static void v4l2_store_frame(const uint8_t* image, uint32_t fourcc, size_t size,
         if ((size_t)n >= sizeof(image_filename))
             break;
 
-        fd = open(image_filename, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+        /* truncated only once known not to be one of the replayed files */
+        fd = open(image_filename, O_WRONLY | O_CREAT, 0664);
         if (-1 == fd){
             fprintf(stderr, "cannot open '%s': %s\n", image_filename, strerror(errno));
             break;
         }
 
+        if (v4l2_capture_is_replay_source(ctx, fd)) {
+            fprintf(stderr, "'%s' is being replayed, not overwritten\n", image_filename);
+            break;
+        }
+
+        if (-1 == ftruncate(fd, 0)) {
+            fprintf(stderr, "ftruncate('%s') failed: %s\n", image_filename, strerror(errno));
+            break;
+        }
+
         if (-1 == write(fd, image, size)) {
             fprintf(stderr, "write() failed: %s\n", strerror(errno));
             break;
@@ -742,29 +549,69 @@ static void v4l2_store_frame(const uint8_t* image, uint32_t fourcc, size_t size,
         close(fd);
 }
 
-static int v4l2_video_capture(int fd, int number_of_frames)
+static int v4l2_frame_callback(struct v4l2_capture* ctx, const struct v4l2_capture_frame* frame, void* user)
 {
-    uint32_t type;
-    void* frame_buffer;
-    size_t frame_size;
-    int i;
+    struct v4l2_capture_state* state = user;
 
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    struct timespec ts;
+    uint64_t done_time_ns;
 
-    if(-1 == ioctl(fd, VIDIOC_STREAMON, &type)) {
-        fprintf(stderr, "VIDIOC_STREAMON failed: %s\n", strerror(errno));
-        return -1;
-    }
+    if (state->timestamps && state->counter < state->max_timestamps)
+        state->timestamps[state->counter] = frame->dequeue_time_ns;
+
+    if (state->counter == 0)
+        state->first_dequeue_time_ns = frame->dequeue_time_ns;
+
+    ++state->counter;
 
-    for (i = 0; i < number_of_frames; ++i)
-        if (0 == v4l2_capture_frame(fd, &frame_buffer, &frame_size))
-            v4l2_store_frame(frame_buffer, selected_format.fmt.pix.pixelformat, frame_size, i + 1);
+    if (state->record_fd != -1)
+        v4l2_capture_record_frame(state->record_fd, frame);
 
-    if(-1 == ioctl(fd, VIDIOC_STREAMOFF, &type)) {
-        fprintf(stderr, "VIDIOC_STREAMOFF failed: %s\n", strerror(errno));
-        return -1;
+    if (state->store_frames)
+        v4l2_store_frame(ctx, state->prefix, frame->data, frame->fourcc, frame->size, state->counter, 1);
+
+    if (state->pyramid && 0 == v4l2_pyramid_build(state->pyramid,
+            frame->fourcc, frame->width, frame->height, frame->data, frame->size)) {
+        int i;
+
+        for (i = 0; i < v4l2_pyramid_get_number_of_levels(state->pyramid); ++i) {
+            const struct v4l2_pyramid_level* level = v4l2_pyramid_get_level(state->pyramid, i);
+
+            if (state->pyramid_levels & (1U << i))
+                v4l2_store_frame(ctx, state->prefix, level->data, level->fourcc, level->size, state->counter, level->scale);
+        }
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    done_time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    state->bytes += frame->size;
+    state->last_done_time_ns = done_time_ns;
+    state->latency_sum_ns += done_time_ns - frame->dequeue_time_ns;
+    if (state->latency_max_ns < done_time_ns - frame->dequeue_time_ns)
+        state->latency_max_ns = done_time_ns - frame->dequeue_time_ns;
+
     return 0;
 }
 
+static void v4l2_print_processing_statistics(const struct v4l2_capture_state* state)
+{
+    uint64_t elapsed_ns;
+
+    if (state->counter == 0)
+        return;
+
+    elapsed_ns = state->last_done_time_ns - state->first_dequeue_time_ns;
+    if (elapsed_ns == 0)
+        elapsed_ns = 1;
+
+    fprintf(stdout,
+        "processing statistics:\n"
+        "\tframes      : %d in %" PRIu64 " us\n"
+        "\tthroughput  : %.1f frames/s, %.1f MB/s\n"
+        "\tlatency     : avg: %" PRIu64 " us, max: %" PRIu64 " us\n",
+        state->counter, elapsed_ns / 1000,
+        state->counter * 1e9 / elapsed_ns, state->bytes * 1e3 / elapsed_ns,
+        state->latency_sum_ns / state->counter / 1000, state->latency_max_ns / 1000
+        );
+}